@@ -48,6 +48,9 @@
 
 // event managers
 #include <event_manager.h>
+#include <event_manager_group.h>
+#include <zerocopy_sender.h>
+#include <rx_buffer_pool.h>
 
 // random number generator interface
 #include <random_generator.h>
@@ -69,6 +72,7 @@
 
 // pcap operations
 #include <pcap_op.h>
+#include <packet_ring.h>
 
 // compression and decompression library
 #include <compress.h>
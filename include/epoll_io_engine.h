@@ -0,0 +1,484 @@
+/**
+ * @brief - implements epoll I/O engine, fallback when io_uring is not supported
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_EPOLL_IO_ENGINE_H__
+#define __AUTO_LIB_EPOLL_IO_ENGINE_H__
+
+#include <cerrno>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <io_engine.h>
+
+namespace auto_os::lib {
+
+/**
+ * @brief - type of epoll_io_engine operation
+ */
+enum class epoll_io_op_type {
+    read,
+    write,
+    accept,
+    timeout,
+};
+
+/**
+ * @brief - implements epoll_io_engine pending operation
+ */
+struct epoll_io_op {
+    epoll_io_op_type type_ = epoll_io_op_type::read;
+    // target fd, the timerfd of a timeout
+    int fd_ = -1;
+    uint8_t *buf_ = nullptr;
+    size_t len_ = 0;
+    int res_ = 0;
+    io_completion_fn fn_;
+};
+
+/**
+ * @brief - operations waiting for readiness of one fd
+ */
+struct epoll_io_fd {
+    std::deque<uint32_t> rd_;
+    std::deque<uint32_t> wr_;
+    uint32_t events_ = 0;
+    // operations were queued by the running flush
+    bool queued_ = false;
+};
+
+/**
+ * @brief - implements I/O engine with readiness from a private epoll instance
+ *
+ * @details - every operation waits for its fd to be ready and then issues a
+ *            single non-blocking syscall, the same completion semantics as io_uring
+ */
+class epoll_io_engine : public io_engine {
+    public:
+        /**
+         * @brief - create epoll instance
+         *
+         * This constructor will throw exception.
+         */
+        explicit epoll_io_engine();
+        ~epoll_io_engine();
+
+        io_engine_type get_type() const noexcept { return io_engine_type::epoll; }
+        int get_fd() const noexcept { return epoll_fd_; }
+
+        int submit_read(int fd, uint8_t *buf, size_t len, io_completion_fn fn) noexcept;
+        int submit_read_fixed(int fd, uint32_t buf_idx, io_completion_fn fn) noexcept;
+        int submit_write(int fd, const uint8_t *buf, size_t len, io_completion_fn fn) noexcept;
+        int submit_accept(int fd, io_completion_fn fn) noexcept;
+        int submit_timeout(uint64_t usec, io_completion_fn fn) noexcept;
+        int cancel_fd(int fd) noexcept;
+        int flush() noexcept;
+        int reap() noexcept;
+
+    private:
+        int epoll_fd_;
+        // signals completions of fds that epoll cannot watch, such as regular files
+        int event_fd_;
+        io_engine_ops<epoll_io_op> ops_;
+        std::vector<uint32_t> submitted_;
+        std::vector<uint32_t> completed_;
+        // completions handed to the callbacks by the running reap
+        std::vector<uint32_t> reaping_;
+        // indexed by fd, the way the event manager keeps its sources
+        std::vector<epoll_io_fd> fds_;
+
+        int submit_(epoll_io_op_type type, int fd, uint8_t *buf, size_t len, io_completion_fn fn);
+        bool try_op_(epoll_io_op &op);
+        void fail_(uint32_t id, int res);
+        epoll_io_fd *find_fd_(int fd);
+        void update_fd_(int fd, epoll_io_fd &wait);
+        void process_fd_(int fd, uint32_t events);
+};
+
+inline epoll_io_engine::epoll_io_engine()
+{
+    struct epoll_event evt = {};
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error("failed to create epoll instance");
+    }
+
+    event_fd_ = eventfd(0, static_cast<int>(EFD_NONBLOCK) | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        close(epoll_fd_);
+        throw std::runtime_error("failed to create eventfd");
+    }
+
+    evt.events = EPOLLIN;
+    evt.data.fd = event_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &evt);
+}
+
+inline epoll_io_engine::~epoll_io_engine()
+{
+    close(event_fd_);
+    close(epoll_fd_);
+}
+
+inline int epoll_io_engine::submit_(epoll_io_op_type type, int fd, uint8_t *buf, size_t len, io_completion_fn fn)
+{
+    uint32_t id = ops_.alloc();
+    epoll_io_op &op = ops_[id];
+
+    op.type_ = type;
+    op.fd_ = fd;
+    op.buf_ = buf;
+    op.len_ = len;
+    op.fn_ = std::move(fn);
+
+    submitted_.push_back(id);
+    return 0;
+}
+
+inline int epoll_io_engine::submit_read(int fd, uint8_t *buf, size_t len, io_completion_fn fn) noexcept
+{
+    return submit_(epoll_io_op_type::read, fd, buf, len, std::move(fn));
+}
+
+inline int epoll_io_engine::submit_read_fixed(int fd, uint32_t buf_idx, io_completion_fn fn) noexcept
+{
+    if (buf_idx >= n_bufs_) {
+        return -1;
+    }
+
+    return submit_(epoll_io_op_type::read, fd, get_buffer(buf_idx), buf_size_, std::move(fn));
+}
+
+inline int epoll_io_engine::submit_write(int fd, const uint8_t *buf, size_t len, io_completion_fn fn) noexcept
+{
+    return submit_(epoll_io_op_type::write, fd, const_cast<uint8_t *>(buf), len, std::move(fn));
+}
+
+inline int epoll_io_engine::submit_accept(int fd, io_completion_fn fn) noexcept
+{
+    return submit_(epoll_io_op_type::accept, fd, nullptr, 0, std::move(fn));
+}
+
+inline int epoll_io_engine::submit_timeout(uint64_t usec, io_completion_fn fn) noexcept
+{
+    struct itimerspec its = {};
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, static_cast<int>(TFD_NONBLOCK) | TFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    its.it_value.tv_sec = usec / 1000000;
+    its.it_value.tv_nsec = (usec % 1000000) * 1000;
+
+    // a zero timeout completes on the next reap
+    if (usec == 0) {
+        its.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(fd, 0, &its, nullptr) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return submit_(epoll_io_op_type::timeout, fd, nullptr, 0, std::move(fn));
+}
+
+inline bool epoll_io_engine::try_op_(epoll_io_op &op)
+{
+    uint64_t expirations;
+    int ret = -1;
+
+    switch (op.type_) {
+        case epoll_io_op_type::read:
+            ret = recv(op.fd_, op.buf_, op.len_, MSG_DONTWAIT);
+            if ((ret < 0) && (errno == ENOTSOCK)) {
+                ret = read(op.fd_, op.buf_, op.len_);
+            }
+        break;
+        case epoll_io_op_type::write:
+            ret = send(op.fd_, op.buf_, op.len_, static_cast<int>(MSG_DONTWAIT) | MSG_NOSIGNAL);
+            if ((ret < 0) && (errno == ENOTSOCK)) {
+                ret = write(op.fd_, op.buf_, op.len_);
+            }
+        break;
+        case epoll_io_op_type::accept:
+            ret = accept4(op.fd_, nullptr, nullptr, static_cast<int>(SOCK_NONBLOCK) | SOCK_CLOEXEC);
+        break;
+        case epoll_io_op_type::timeout:
+            ret = read(op.fd_, &expirations, sizeof(expirations));
+            if (ret == sizeof(expirations)) {
+                close(op.fd_);
+                op.res_ = -ETIME;
+                return true;
+            }
+        break;
+    }
+
+    if (ret < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+            return false;
+        }
+        op.res_ = -errno;
+        if (op.type_ == epoll_io_op_type::timeout) {
+            close(op.fd_);
+        }
+        return true;
+    }
+
+    op.res_ = ret;
+    return true;
+}
+
+inline void epoll_io_engine::fail_(uint32_t id, int res)
+{
+    epoll_io_op &op = ops_[id];
+
+    // the timerfd of a timeout belongs to the engine
+    if (op.type_ == epoll_io_op_type::timeout) {
+        close(op.fd_);
+    }
+
+    op.res_ = res;
+    completed_.push_back(id);
+}
+
+inline epoll_io_fd *epoll_io_engine::find_fd_(int fd)
+{
+    if ((fd < 0) || (static_cast<size_t>(fd) >= fds_.size())) {
+        return nullptr;
+    }
+
+    return &fds_[fd];
+}
+
+inline void epoll_io_engine::update_fd_(int fd, epoll_io_fd &wait)
+{
+    struct epoll_event evt = {};
+    uint32_t events = 0;
+    int ret;
+
+    if (!wait.rd_.empty()) {
+        events |= EPOLLIN;
+    }
+    if (!wait.wr_.empty()) {
+        events |= EPOLLOUT;
+    }
+
+    // new operations check the registration again, fd may have been closed and
+    // its number reused without cancel_fd, which drops it from epoll silently
+    if ((events == wait.events_) && !wait.queued_) {
+        return;
+    }
+    wait.queued_ = false;
+
+    evt.events = events;
+    evt.data.fd = fd;
+
+    if (events == 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        wait.events_ = 0;
+        return;
+    }
+
+    ret = -1;
+    errno = ENOENT;
+    if (wait.events_ != 0) {
+        ret = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &evt);
+    }
+
+    // not watched yet, or fd was closed without cancel_fd and its number reused
+    if ((ret < 0) && (errno == ENOENT)) {
+        ret = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &evt);
+        // regular files are always ready, complete them from the next reap
+        if ((ret < 0) && (errno == EPERM)) {
+            for (auto id : wait.rd_) {
+                try_op_(ops_[id]);
+                completed_.push_back(id);
+            }
+            for (auto id : wait.wr_) {
+                try_op_(ops_[id]);
+                completed_.push_back(id);
+            }
+            wait.rd_.clear();
+            wait.wr_.clear();
+            events = 0;
+
+            uint64_t one = 1;
+            write(event_fd_, &one, sizeof(one));
+        } else if (ret < 0) {
+            // an fd epoll cannot watch never turns ready, fail its operations now
+            int err = errno;
+
+            for (auto id : wait.rd_) {
+                fail_(id, -err);
+            }
+            for (auto id : wait.wr_) {
+                fail_(id, -err);
+            }
+            wait.rd_.clear();
+            wait.wr_.clear();
+            events = 0;
+
+            uint64_t one = 1;
+            write(event_fd_, &one, sizeof(one));
+        }
+    }
+
+    wait.events_ = events;
+}
+
+inline int epoll_io_engine::cancel_fd(int fd) noexcept
+{
+    uint64_t one = 1;
+    size_t i = 0;
+
+    // queued since the last flush, never handed to epoll
+    while (i < submitted_.size()) {
+        if (ops_[submitted_[i]].fd_ == fd) {
+            fail_(submitted_[i], -ECANCELED);
+            submitted_.erase(submitted_.begin() + i);
+        } else {
+            i ++;
+        }
+    }
+
+    epoll_io_fd *wait = find_fd_(fd);
+    if (wait) {
+        for (auto id : wait->rd_) {
+            fail_(id, -ECANCELED);
+        }
+        for (auto id : wait->wr_) {
+            fail_(id, -ECANCELED);
+        }
+        if (wait->events_ != 0) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        }
+        wait->rd_.clear();
+        wait->wr_.clear();
+        wait->events_ = 0;
+        wait->queued_ = false;
+    }
+
+    // the cancelled operations complete from the next reap
+    write(event_fd_, &one, sizeof(one));
+
+    return 0;
+}
+
+inline int epoll_io_engine::flush() noexcept
+{
+    int count = submitted_.size();
+    size_t i = 0;
+
+    // a negative fd completes with -EBADF, the same as io_uring reports it
+    while (i < submitted_.size()) {
+        if (ops_[submitted_[i]].fd_ < 0) {
+            uint64_t one = 1;
+
+            fail_(submitted_[i], -EBADF);
+            submitted_.erase(submitted_.begin() + i);
+            write(event_fd_, &one, sizeof(one));
+        } else {
+            i ++;
+        }
+    }
+
+    for (auto id : submitted_) {
+        epoll_io_op &op = ops_[id];
+
+        if (static_cast<size_t>(op.fd_) >= fds_.size()) {
+            fds_.resize(op.fd_ + 1);
+        }
+        epoll_io_fd &wait = fds_[op.fd_];
+
+        if (op.type_ == epoll_io_op_type::write) {
+            wait.wr_.push_back(id);
+        } else {
+            wait.rd_.push_back(id);
+        }
+        wait.queued_ = true;
+    }
+
+    for (auto id : submitted_) {
+        int fd = ops_[id].fd_;
+
+        update_fd_(fd, fds_[fd]);
+    }
+    submitted_.clear();
+
+    return count;
+}
+
+inline void epoll_io_engine::process_fd_(int fd, uint32_t events)
+{
+    epoll_io_fd *found = find_fd_(fd);
+    if (!found) {
+        return;
+    }
+
+    epoll_io_fd &wait = *found;
+
+    // errors and hangups complete the waiting operations with the syscall result
+    if (events & (static_cast<uint32_t>(EPOLLIN) | EPOLLERR | EPOLLHUP)) {
+        while (!wait.rd_.empty() && try_op_(ops_[wait.rd_.front()])) {
+            completed_.push_back(wait.rd_.front());
+            wait.rd_.pop_front();
+        }
+    }
+    if (events & (static_cast<uint32_t>(EPOLLOUT) | EPOLLERR | EPOLLHUP)) {
+        while (!wait.wr_.empty() && try_op_(ops_[wait.wr_.front()])) {
+            completed_.push_back(wait.wr_.front());
+            wait.wr_.pop_front();
+        }
+    }
+
+    update_fd_(fd, wait);
+}
+
+inline int epoll_io_engine::reap() noexcept
+{
+    struct epoll_event evts[64];
+    uint64_t val;
+    int count = 0;
+    int ret;
+    int i;
+
+    ret = epoll_wait(epoll_fd_, evts, 64, 0);
+    for (i = 0; i < ret; i ++) {
+        if (evts[i].data.fd == event_fd_) {
+            read(event_fd_, &val, sizeof(val));
+            continue;
+        }
+        process_fd_(evts[i].data.fd, evts[i].events);
+    }
+
+    // callbacks may submit again, which must not touch the list being walked
+    reaping_.swap(completed_);
+
+    for (auto id : reaping_) {
+        io_completion_fn fn = std::move(ops_[id].fn_);
+        int res = ops_[id].res_;
+
+        ops_.release(id);
+        if (fn) {
+            fn(res);
+        }
+        count ++;
+    }
+    reaping_.clear();
+
+    return count;
+}
+
+}
+
+#endif
+
@@ -13,96 +13,155 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <functional>
+#include <algorithm>
 #include <queue>
 #include <condition_variable>
-#include <sys/select.h>
+#include <stdexcept>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <pthread.h>
 
 #include <logger.h>
+#include <inline_fn.h>
+#include <timer_wheel.h>
+#include <event_manager_stats.h>
+#include <io_engine_factory.h>
+#include <mpsc_queue.h>
+#include <thread_pool.h>
+#include <thread_intf.h>
+#include <socket_api.h>
 
 namespace auto_os::lib {
 
+// the event loop is header only, the versioned namespace keeps it apart from the
+// event_manager symbols still exported by the prebuilt libauto_lib.so
+inline namespace v2 {
+
 // timer callback
-typedef std::function<void(void)> timer_fn;
+typedef inline_fn<void(void)> timer_fn;
 
 // socket callback
-typedef std::function<void(int)> socket_fn;
+typedef inline_fn<void(int)> socket_fn;
 
 // signal callback
-typedef std::function<void(int)> signal_fn;
+typedef inline_fn<void(int)> signal_fn;
 
-// job callback
-typedef std::function<void(void)> job_fn;
+// udp batch callback, called with the datagrams of one recvmmsg
+typedef inline_fn<void(udp_msg *msgs, int n_msgs)> udp_batch_fn;
 
-/*
- * @brief - a process that is instantiated by the Parallel
+/**
+ * @brief - implements event_manager socket
  */
-class thread_worker {
-    public:
-        explicit thread_worker();
-        ~thread_worker();
-
-        void queue_work(job_fn job);
-        void stop();
-
-    private:
-        void process();
-        std::unique_ptr<std::thread> proc_;
-        std::queue<job_fn> jobs_;
-        std::mutex lock_;
-        std::condition_variable cv_;
-        bool stop_signal_ = false;
+struct event_manager_socket {
+    int fd_;
+    socket_fn socket_fn_;
+    // called when the socket has errors queued, such as MSG_ZEROCOPY completions
+    socket_fn error_fn_;
+    // called when the socket is writable while write_armed_ is set
+    socket_fn write_fn_;
+    bool write_armed_ = false;
+    // epoll mask of the socket without EPOLLOUT
+    uint32_t events_ = 0;
+    // set for udp batch events, the loop receives into udp_msgs_ itself
+    udp_batch_fn udp_batch_fn_;
+    udp_msg *udp_msgs_ = nullptr;
+    int udp_n_msgs_ = 0;
 };
 
 /**
- * @brief - implements threadpool design pattern
+ * @brief - implements event_manager signal
  */
-class thread_pool {
-    public:
-        explicit thread_pool();
-        ~thread_pool();
+struct event_manager_signal {
+    uint32_t sig;
+    std::vector<signal_fn> signal_fn_;
+};
 
-        void queue_work(job_fn job);
-        void stopall();
-    private:
-        std::vector<std::shared_ptr<thread_worker>> procs_;
-        int n_threads_;
+/**
+ * @brief - epoll trigger mode of a socket event
+ */
+enum class evt_trigger_mode {
+    // callback is called as long as the socket has data pending
+    level,
+    // callback is called once per readiness change, the callback must drain the socket
+    edge,
 };
 
 /**
- * @brief - implements event_manager timer
+ * @brief - type of the source registered against a file descriptor
  */
-struct event_manager_timer {
-    int sec_;
-    int usec_;
-    int fd_;
-    bool oneshot_;
-    bool complete_;
-    timer_fn timer_fn_;
+enum class event_manager_source_type {
+    none,
+    socket,
+    timer,
+    signal,
+    io,
+    wakeup,
 };
 
 /**
- * @brief - implements event_manager socket
+ * @brief - implements event_manager source, indexed by its file descriptor
  */
-struct event_manager_socket {
-    int fd_;
-    socket_fn socket_fn_;
+struct event_manager_source {
+    event_manager_source_type type_ = event_manager_source_type::none;
+    // bumped every time the slot is added or removed, stale epoll events are dropped
+    uint32_t gen_ = 0;
+    // time allowed from readiness to the end of the callback, 0 for none
+    uint64_t deadline_nsec_ = 0;
+    uint64_t deadline_misses_ = 0;
+    event_manager_socket socket_;
 };
 
 /**
- * @brief - implements event_manager signal
+ * @brief - implements entry of the run queue of one wakeup
  */
-struct event_manager_signal {
-    uint32_t sig;
-    std::vector<signal_fn> signal_fn_;
+struct event_manager_ready {
+    // absolute monotonic deadline in nanoseconds, UINT64_MAX for none
+    uint64_t deadline_;
+    // position in the epoll result, keeps sources without deadline in order
+    uint32_t seq_;
+    uint32_t events_;
+    uint64_t data_;
+
+    bool operator<(const event_manager_ready &other) const
+    {
+        return (deadline_ < other.deadline_) ||
+               ((deadline_ == other.deadline_) && (seq_ < other.seq_));
+    }
 };
 
-struct deadline_context {
-    int deadline_msec;
-    timer_fn timer_fn_;
-    socket_fn sock_fn_;
+/**
+ * @brief - handle of a socket event, checked against the generation of its slot
+ */
+struct socket_handle {
+    int fd_ = -1;
+    uint32_t gen_ = 0;
+
+    /**
+     * @brief - returns false if the socket event could not be created
+     */
+    bool valid() const { return fd_ >= 0; }
 };
 
+// maximum number of ready events collected per epoll_wait
+static constexpr int event_manager_max_events = 256;
+
+// default timer tick resolution in microseconds
+static constexpr uint32_t event_manager_default_tick_usec = 1000;
+
+// recvmmsg calls made per readiness of a udp batch event, the rest waits for the next wakeup
+static constexpr int event_manager_udp_drain_batches = 16;
+
+// number of jobs that can be posted to the loop before post fails
+static constexpr size_t event_manager_post_queue_size = 4096;
+
 // Grand Central Dispatch main class
 class event_manager {
     public:
@@ -113,6 +172,17 @@ class event_manager {
             return &em;
         }
 
+        /**
+         * @brief - create an independent event loop
+         *
+         * @details - instance() returns the process wide loop, each loop created
+         *            here owns its own epoll, timers and thread and is run by
+         *            calling start() from the thread that should own it
+         *
+         * This constructor will throw exception.
+         */
+        explicit event_manager();
+
         /**
          * @brief - set logger instance
          */
@@ -128,29 +198,266 @@ class event_manager {
 
         ~event_manager();
 
+        /**
+         * @brief - set default trigger mode of the socket events created afterwards
+         *
+         * @param in mode - level or edge triggered
+         */
+        void set_trigger_mode(evt_trigger_mode mode) { trigger_mode_ = mode; }
+
+        /**
+         * @brief - set resolution of the timer wheel
+         *
+         * @param in usec - tick in microseconds, timer expiries are rounded up to it
+         *
+         * @return 0 on success -1 if timers are already armed
+         */
+        int set_timer_resolution(uint32_t usec) noexcept;
+
         // create timer event with sec, usec and a callback
-        int create_timer_event(int sec, int usec, timer_fn ti_fn) noexcept;
+        timer_handle create_timer_event(int sec, int usec, timer_fn ti_fn) noexcept;
 
         // create oneshot timer event with sec, usec and a callback
-        int create_timer_event(bool oneshot, int sec, int usec, timer_fn ti_fn) noexcept;
+        timer_handle create_timer_event(bool oneshot, int sec, int usec, timer_fn ti_fn) noexcept;
 
         // delete oneshot timer event if no longer required
         int delete_timer_event(timer_fn ti_fn) noexcept;
 
+        /**
+         * @brief - delete timer event in O(1)
+         *
+         * @param in h - handle returned by create_timer_event
+         *
+         * @details - safe from the timer's own callback and from other threads,
+         *            a handle of an expired oneshot timer is rejected
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int delete_timer_event(timer_handle h) noexcept;
+
+        /**
+         * @brief - restart a periodic timer with a new period, keeps the handle valid
+         *
+         * @param in h - handle returned by create_timer_event
+         * @param in sec - seconds
+         * @param in usec - micro seconds
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int rearm_timer_event(timer_handle h, int sec, int usec) noexcept;
+
+        /**
+         * @brief - restart a timer with a new timeout, keeps the handle valid
+         *
+         * @param in h - handle returned by create_timer_event
+         * @param in oneshot - true if the timer fires once
+         * @param in sec - seconds
+         * @param in usec - micro seconds
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int rearm_timer_event(timer_handle h, bool oneshot, int sec, int usec) noexcept;
+
         // create socket event with fd and a callback
-        int create_socket_event(int fd, socket_fn s_fn) noexcept;
+        socket_handle create_socket_event(int fd, socket_fn s_fn) noexcept;
+
+        /**
+         * @brief - create socket event with fd, callback and trigger mode
+         *
+         * @param in fd - socket
+         * @param in s_fn - callback called when the socket is readable
+         * @param in mode - level or edge triggered
+         *
+         * @return handle of the socket event, invalid on failure
+         */
+        socket_handle create_socket_event(int fd, socket_fn s_fn, evt_trigger_mode mode) noexcept;
+
+        /**
+         * @brief - create udp socket event that receives a batch of datagrams per recvmmsg
+         *
+         * @param in fd - udp socket
+         * @param in msgs - datagrams with buffers owned by the caller, alive until the event is deleted
+         * @param in n_msgs - number of datagrams, at most udp_batch_max are received per call
+         * @param in fn - callback called with each batch received
+         *
+         * @details - one readiness drains up to event_manager_udp_drain_batches batches.
+         *            the event is deleted with delete_socket_event
+         *
+         * @return handle of the socket event, invalid on failure
+         */
+        socket_handle create_udp_batch_event(int fd, udp_msg *msgs, int n_msgs, udp_batch_fn fn) noexcept;
+
+        /**
+         * @brief - set callback called when the socket has errors queued
+         *
+         * @param in fd - socket, watched for errors only if it is not a socket event yet
+         * @param in fn - callback, nullptr to remove it
+         *
+         * @details - the callback reads the error queue with MSG_ERRQUEUE, such as the
+         *            completions of MSG_ZEROCOPY sends. a socket event created later on
+         *            the same fd keeps the callback
+         *
+         * @return 0 on success -1 on failure
+         */
+        int set_error_event(int fd, socket_fn fn) noexcept;
+
+        /**
+         * @brief - set callback called when a socket event turns writable
+         *
+         * @param in fd - socket of a socket event
+         * @param in fn - callback, kept until the socket event is deleted
+         *
+         * @details - the socket is watched for writes only while armed with arm_write_event
+         *
+         * @return 0 on success -1 if fd is not a socket event
+         */
+        int set_write_event(int fd, socket_fn fn) noexcept;
+
+        /**
+         * @brief - start or stop watching a socket event for writes
+         *
+         * @param in fd - socket of a socket event
+         * @param in arm - true while there is output queued, the write callback is level triggered
+         *
+         * @return 0 on success -1 on failure
+         */
+        int arm_write_event(int fd, bool arm) noexcept;
 
         // delete socket event if closed / not need to listen to it any longer
         int delete_socket_event(int fd) noexcept;
 
+        /**
+         * @brief - delete socket event, ignored if the fd was since reused by another event
+         *
+         * @param in h - handle returned by create_socket_event
+         *
+         * @return 0 on success -1 if the handle is stale
+         */
+        int delete_socket_event(socket_handle h) noexcept;
+
         // create signal event with signal no and a callback
         int create_signal_event(uint32_t sig, signal_fn s_fn) noexcept;
 
         int register_term_signals(signal_fn s_fn) noexcept;
 
+        /**
+         * @brief - set deadline of a socket event
+         *
+         * @param in h - handle returned by create_socket_event
+         * @param in usec - time from the socket turning ready to the end of its callback,
+         *                  0 to remove the deadline
+         *
+         * @details - ready sockets and timers run in earliest deadline first order,
+         *            sources without deadline run after them. a callback finishing
+         *            late counts as a miss of the socket
+         *
+         * @return 0 on success -1 if the handle is stale
+         */
+        int set_deadline(socket_handle h, uint32_t usec) noexcept;
+
+        /**
+         * @brief - set deadline of a timer event
+         *
+         * @param in h - handle returned by create_timer_event
+         * @param in usec - time from the expiry of the timer to the end of its callback,
+         *                  0 to remove the deadline
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int set_deadline(timer_handle h, uint32_t usec) noexcept;
+
+        /**
+         * @brief - get deadline misses of a socket event
+         *
+         * @param in h - handle returned by create_socket_event
+         * @param out misses - callbacks that finished after their deadline
+         *
+         * @return 0 on success -1 if the handle is stale
+         */
+        int get_deadline_misses(socket_handle h, uint64_t &misses) noexcept;
+
+        /**
+         * @brief - get deadline misses of a timer event
+         *
+         * @param in h - handle returned by create_timer_event
+         * @param out misses - callbacks that finished after their deadline
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int get_deadline_misses(timer_handle h, uint64_t &misses) noexcept;
+
         // run an execution context
         void run_execution(job_fn job) noexcept;
 
+        /**
+         * @brief - run a job on the loop thread, safe from any thread
+         *
+         * @param in job - job to run
+         *
+         * @details - lock-free, the loop is woken up once per batch of posts
+         *            rather than once per post
+         *
+         * @return 0 on success -1 if the post queue is full
+         */
+        int post(job_fn job) noexcept;
+
+        /**
+         * @brief - attach an asynchronous I/O engine to the loop
+         *
+         * @param in type - io_uring, falls back to epoll if the kernel lacks support
+         * @param in entries - submission queue size
+         *
+         * @details - operations submitted on the engine are flushed in one batch
+         *            before the loop sleeps and their callbacks run on the loop
+         *
+         * @return 0 on success -1 on failure
+         */
+        int enable_io_engine(io_engine_type type, uint32_t entries) noexcept;
+
+        /**
+         * @brief - returns the attached I/O engine, nullptr if not enabled
+         */
+        io_engine *get_io_engine() noexcept { return io_.get(); }
+
+        /**
+         * @brief - collect callback durations, timer lateness and wakeup statistics
+         *
+         * @param in enable - true to collect, costs two clock reads per callback
+         */
+        void enable_stats(bool enable) noexcept;
+
+        /**
+         * @brief - log callbacks that run longer than the threshold via the logger
+         *
+         * @param in usec - threshold in microseconds, 0 to disable
+         */
+        void set_slow_callback_threshold(uint32_t usec) noexcept;
+
+        /**
+         * @brief - returns snapshot of the statistics collected so far
+         */
+        event_manager_stats get_stats() noexcept;
+
+        /**
+         * @brief - clear the statistics
+         */
+        void reset_stats() noexcept;
+
+        /**
+         * @brief - spin on the ready set before blocking, trades cpu for wakeup latency
+         *
+         * @param in spin_usec - time to poll without sleeping after each wakeup, 0 to disable
+         * @param in sock_usec - SO_BUSY_POLL set on the socket events, 0 to leave them alone
+         * @param in cpu - cpu the thread calling start() is pinned to, -1 for no pinning
+         *
+         * @details - raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN,
+         *            sockets that refuse it are still watched. the cpu is pinned on the
+         *            next call to start()
+         *
+         * @return 0 on success -1 on invalid cpu
+         */
+        int enable_busy_poll(uint32_t spin_usec, uint32_t sock_usec, int cpu = -1) noexcept;
+
         // run the main event manager
         void start() noexcept;
 
@@ -159,51 +466,1117 @@ class event_manager {
          *
          * @return void
          */
-        inline void terminate() { terminate_ = true; }
+        inline void terminate() { terminate_ = true; wakeup_(); }
     private:
 
         // logging instance pointer
         std::shared_ptr<auto_os::lib::logger> log_;
 
-        // list of timers
-        std::vector<event_manager_timer> timers_;
+        // sockets and the timer wheel's timerfd, indexed by their fd. slots live on the heap so that
+        // a callback stays valid while the table grows underneath it
+        std::vector<std::unique_ptr<event_manager_source>> sources_;
 
-        // list of sockets
-        std::vector<event_manager_socket> sockets_;
+        // sources deleted while dispatching, parked whole so that a running callback is
+        // never moved or destroyed under itself. freed once the batch is done
+        std::vector<std::unique_ptr<event_manager_source>> retired_;
 
         // list of signals
         std::vector<event_manager_signal> signals_;
 
-        std::vector<deadline_context> deadline_ctx_;
+        // all timers, driven by a single timerfd
+        timer_wheel timers_;
+
+        // timerfd of the timer wheel
+        int timer_fd_;
+
+        // timer wheel tick in microseconds
+        uint32_t tick_usec_ = event_manager_default_tick_usec;
+
+        // tick the timerfd is armed for, UINT64_MAX if disarmed
+        uint64_t armed_tick_ = UINT64_MAX;
+
+        // monotonic time of tick 0 in nanoseconds
+        uint64_t base_nsec_;
+
+        // shortest deadline set on a timer, the timerfd is ranked by it. UINT64_MAX for none
+        uint64_t timer_deadline_nsec_ = UINT64_MAX;
+
+        // ready events of the current wakeup, in deadline order
+        std::vector<event_manager_ready> run_queue_;
 
         // parallel context
         std::unique_ptr<thread_pool> p_;
 
+        // asynchronous I/O engine
+        std::shared_ptr<io_engine> io_;
+
         // set to true when Terminate() is called
-        bool terminate_ = false;
+        std::atomic<bool> terminate_{false};
+
+        // guards the sources and timers, held while a batch of events is dispatched
+        std::recursive_mutex lock_;
+
+        // set while the ready events are being dispatched
+        bool dispatching_ = false;
+
+        // default trigger mode of socket events
+        evt_trigger_mode trigger_mode_ = evt_trigger_mode::level;
+
+        // statistics, updated by the loop thread under lock_
+        event_manager_stats stats_;
+        bool stats_enabled_ = false;
+        uint64_t slow_cb_nsec_ = 0;
+
+        // busy poll budget, read by the loop without the lock
+        std::atomic<uint64_t> busy_poll_nsec_{0};
+        uint32_t sock_busy_poll_usec_ = 0;
+        int busy_poll_cpu_ = -1;
+
+        // epoll instance
+        int epoll_fd_;
 
         // fd to handle the signals
         int signal_fd_;
 
+        // eventfd to wake the loop up from other threads
+        int wakeup_fd_;
+
+        // jobs posted from other threads
+        mpsc_queue<job_fn> posted_{event_manager_post_queue_size};
+
+        // set while a wakeup for the posted jobs is outstanding
+        std::atomic<bool> post_pending_{false};
+
         // maks of all the signals
         sigset_t signal_masks_;
 
-        // maks of all the fds
-        fd_set allfd_;
+        int add_source_(int fd, uint32_t events, event_manager_source_type type);
+        void remove_source_(int fd);
+        uint64_t deadline_of_(uint64_t data, uint64_t &now);
+        void dispatch_(uint64_t data, uint64_t deadline, uint32_t events);
+        bool error_only_(int fd) const;
+        void dispatch_udp_batch_(event_manager_source &src, int fd);
+        void dispatch_timers_();
+        uint64_t mono_nsec_() const;
+        uint64_t current_tick_() const;
+        uint64_t usec_to_ticks_(int sec, int usec) const;
+        void arm_timer_fd_();
+        void dispatch_signals_();
 
-        std::unique_ptr<std::thread> deadline_thr_;
+        int wait_(struct epoll_event *evts, int &spin_hit);
+        void set_sock_busy_poll_(int fd);
+        void wakeup_();
+        void run_posted_();
+        bool measure_() const { return stats_enabled_ || (slow_cb_nsec_ > 0); }
+        void record_cb_(event_manager_histogram &hist, uint64_t start, const char *source);
+};
 
-        // get allmax fds
-        int get_max_fd_();
+inline event_manager::event_manager()
+{
+    signal_fd_ = -1;
+    sigemptyset(&signal_masks_);
 
-        void deadline_check();
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error("failed to create epoll instance");
+    }
 
-        // priovate constructor .. base singleton
-        explicit event_manager();
-};
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, static_cast<int>(TFD_NONBLOCK) | TFD_CLOEXEC);
+    if ((timer_fd_ < 0) || (add_source_(timer_fd_, EPOLLIN, event_manager_source_type::timer) < 0)) {
+        // the destructor does not run for a constructor that throws
+        if (timer_fd_ >= 0) {
+            close(timer_fd_);
+        }
+        close(epoll_fd_);
+        throw std::runtime_error("failed to create timer wheel timerfd");
+    }
+    base_nsec_ = mono_nsec_();
+
+    timers_.set_hook([this](uint64_t expires, timer_wheel_node &n) {
+        uint64_t start = measure_() ? mono_nsec_() : 0;
+        uint64_t due = base_nsec_ + expires * tick_usec_ * 1000ULL;
+        uint64_t end;
+
+        if (start && stats_enabled_) {
+            stats_.timer_late_ns_.record((start > due) ? (start - due) : 0);
+        }
+
+        n.fn_();
+        if (start) {
+            record_cb_(stats_.timer_cb_ns_, start, "timer");
+        }
+
+        // the node outlives its callback even if the callback cancelled it
+        if (n.deadline_ > 0) {
+            end = mono_nsec_();
+            if (end > due + n.deadline_) {
+                n.deadline_misses_ ++;
+                stats_.timer_deadline_misses_ ++;
+                if (log_) {
+                    log_->warning("event_manager: timer missed its deadline by %lu usec\n",
+                                  (end - due - n.deadline_) / 1000);
+                }
+            }
+        }
+    });
+
+    wakeup_fd_ = eventfd(0, static_cast<int>(EFD_NONBLOCK) | EFD_CLOEXEC);
+    if ((wakeup_fd_ < 0) || (add_source_(wakeup_fd_, EPOLLIN, event_manager_source_type::wakeup) < 0)) {
+        if (wakeup_fd_ >= 0) {
+            close(wakeup_fd_);
+        }
+        close(timer_fd_);
+        close(epoll_fd_);
+        throw std::runtime_error("failed to create wakeup eventfd");
+    }
+
+    // the thread pool is created on the first run_execution, a loop per core
+    // must not spawn a pool per loop
 
+    run_queue_.reserve(event_manager_max_events);
 }
 
-#endif
+inline event_manager::~event_manager()
+{
+    close(timer_fd_);
+    close(wakeup_fd_);
+    if (signal_fd_ >= 0) {
+        close(signal_fd_);
+    }
+    if (p_) {
+        p_->stopall();
+    }
+    close(epoll_fd_);
+}
+
+inline void event_manager::wakeup_()
+{
+    uint64_t one = 1;
+
+    write(wakeup_fd_, &one, sizeof(one));
+}
+
+inline int event_manager::post(job_fn job) noexcept
+{
+    if (!posted_.push(std::move(job))) {
+        return -1;
+    }
+
+    // only the first post after the loop drained the queue pays for the syscall
+    if (!post_pending_.exchange(true)) {
+        wakeup_();
+    }
+
+    return 0;
+}
+
+inline void event_manager::run_posted_()
+{
+    size_t count = 0;
+    job_fn job;
+
+    // posts racing with the drain below see the flag cleared and wake the loop again
+    post_pending_.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // bounded so that a producer that keeps posting cannot starve the other events
+    while ((count < posted_.capacity()) && posted_.pop(job)) {
+        uint64_t start = measure_() ? mono_nsec_() : 0;
+
+        job();
+        if (start) {
+            record_cb_(stats_.posted_cb_ns_, start, "posted");
+        }
+        count ++;
+    }
+
+    if ((count == posted_.capacity()) && !post_pending_.exchange(true)) {
+        wakeup_();
+    }
+}
+
+inline void event_manager::enable_stats(bool enable) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    stats_enabled_ = enable;
+}
+
+inline void event_manager::set_slow_callback_threshold(uint32_t usec) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    slow_cb_nsec_ = usec * 1000ULL;
+}
+
+inline event_manager_stats event_manager::get_stats() noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    return stats_;
+}
+
+inline void event_manager::reset_stats() noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    stats_ = event_manager_stats();
+}
+
+inline void event_manager::record_cb_(event_manager_histogram &hist, uint64_t start, const char *source)
+{
+    uint64_t nsec = mono_nsec_() - start;
+
+    if (stats_enabled_) {
+        hist.record(nsec);
+    }
+
+    if ((slow_cb_nsec_ > 0) && (nsec > slow_cb_nsec_)) {
+        stats_.slow_callbacks_ ++;
+        if (log_) {
+            log_->warning("event_manager: %s callback took %lu usec\n", source, nsec / 1000);
+        }
+    }
+}
+
+inline int event_manager::add_source_(int fd, uint32_t events, event_manager_source_type type)
+{
+    struct epoll_event evt = {};
+    int ret;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (static_cast<size_t>(fd) >= sources_.size()) {
+        sources_.resize(fd + 1);
+    }
+    if (!sources_[fd]) {
+        sources_[fd] = std::make_unique<event_manager_source>();
+    }
+
+    event_manager_source &src = *sources_[fd];
+    if (src.type_ != event_manager_source_type::none) {
+        return -1;
+    }
+
+    src.gen_ ++;
+    evt.events = events;
+    evt.data.u64 = (static_cast<uint64_t>(src.gen_) << 32) | static_cast<uint32_t>(fd);
 
+    ret = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &evt);
+    if (ret < 0) {
+        return -1;
+    }
+
+    src.type_ = type;
+    return 0;
+}
+
+inline void event_manager::remove_source_(int fd)
+{
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+
+    // the callback being removed may be the one currently running, the slot keeps
+    // counting generations so that handles of the parked source stay stale
+    if (dispatching_) {
+        uint32_t gen = sources_[fd]->gen_ + 1;
+
+        sources_[fd]->type_ = event_manager_source_type::none;
+        sources_[fd]->gen_ = gen;
+        retired_.push_back(std::move(sources_[fd]));
+
+        sources_[fd] = std::make_unique<event_manager_source>();
+        sources_[fd]->gen_ = gen;
+        return;
+    }
+
+    event_manager_source &src = *sources_[fd];
+
+    src.type_ = event_manager_source_type::none;
+    src.gen_ ++;
+    src.deadline_nsec_ = 0;
+    src.deadline_misses_ = 0;
+    src.socket_.socket_fn_ = nullptr;
+    src.socket_.error_fn_ = nullptr;
+    src.socket_.write_fn_ = nullptr;
+    src.socket_.write_armed_ = false;
+    src.socket_.events_ = 0;
+    src.socket_.udp_batch_fn_ = nullptr;
+    src.socket_.udp_msgs_ = nullptr;
+    src.socket_.udp_n_msgs_ = 0;
+}
+
+inline timer_handle event_manager::create_timer_event(int sec, int usec, timer_fn ti_fn) noexcept
+{
+    return create_timer_event(false, sec, usec, std::move(ti_fn));
+}
+
+inline uint64_t event_manager::mono_nsec_() const
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+inline uint64_t event_manager::current_tick_() const
+{
+    return (mono_nsec_() - base_nsec_) / (tick_usec_ * 1000ULL);
+}
+
+inline void event_manager::arm_timer_fd_()
+{
+    struct itimerspec its = {};
+    uint64_t next = timers_.next_tick();
+    uint64_t nsec;
+
+    if (next == armed_tick_) {
+        return;
+    }
+
+    // zero it_value disarms the timerfd
+    if (next != UINT64_MAX) {
+        nsec = base_nsec_ + next * tick_usec_ * 1000ULL;
+        its.it_value.tv_sec = nsec / 1000000000ULL;
+        its.it_value.tv_nsec = nsec % 1000000000ULL;
+    }
+
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr) == 0) {
+        armed_tick_ = next;
+    }
+}
+
+inline int event_manager::set_timer_resolution(uint32_t usec) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if ((usec == 0) || (timers_.size() > 0)) {
+        return -1;
+    }
+
+    tick_usec_ = usec;
+    base_nsec_ = mono_nsec_();
+
+    // the wheel keeps counting from its own tick, realign the base to it
+    base_nsec_ -= timers_.now() * tick_usec_ * 1000ULL;
+    armed_tick_ = UINT64_MAX;
+
+    return 0;
+}
+
+inline uint64_t event_manager::usec_to_ticks_(int sec, int usec) const
+{
+    uint64_t total_usec = sec * 1000000ULL + usec;
+
+    return (total_usec + tick_usec_ - 1) / tick_usec_;
+}
+
+inline timer_handle event_manager::create_timer_event(bool oneshot, int sec, int usec, timer_fn ti_fn) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    timer_handle h;
+    uint64_t ticks;
+
+    if ((sec < 0) || (usec < 0) || ((sec == 0) && (usec == 0))) {
+        return h;
+    }
+
+    ticks = usec_to_ticks_(sec, usec);
+    h = timers_.add(current_tick_() + ticks, oneshot ? 0 : ticks, std::move(ti_fn));
+
+    // only an earlier expiry needs the timerfd to be moved
+    if (timers_.next_tick() < armed_tick_) {
+        arm_timer_fd_();
+    }
+
+    return h;
+}
+
+inline int event_manager::delete_timer_event(timer_fn ti_fn) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    // callables have no equality, match by target type and function pointer
+    typedef void (*fn_ptr)(void);
+    const fn_ptr *target = ti_fn.target<fn_ptr>();
+
+    return timers_.cancel_if([&](const timer_fn &cur) {
+        if (cur.target_type() != ti_fn.target_type()) {
+            return false;
+        }
+        return !target || (*cur.target<fn_ptr>() == *target);
+    });
+}
+
+inline int event_manager::delete_timer_event(timer_handle h) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    // a cancelled timer leaves at most one spurious timerfd wakeup behind
+    return timers_.cancel(h);
+}
+
+inline int event_manager::rearm_timer_event(timer_handle h, int sec, int usec) noexcept
+{
+    return rearm_timer_event(h, false, sec, usec);
+}
+
+inline int event_manager::rearm_timer_event(timer_handle h, bool oneshot, int sec, int usec) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    uint64_t ticks;
+    int ret;
+
+    if ((sec < 0) || (usec < 0) || ((sec == 0) && (usec == 0))) {
+        return -1;
+    }
+
+    ticks = usec_to_ticks_(sec, usec);
+    ret = timers_.rearm(h, current_tick_() + ticks, oneshot ? 0 : ticks);
+    if (ret < 0) {
+        return -1;
+    }
+
+    if (timers_.next_tick() < armed_tick_) {
+        arm_timer_fd_();
+    }
+
+    return 0;
+}
+
+inline socket_handle event_manager::create_socket_event(int fd, socket_fn s_fn) noexcept
+{
+    return create_socket_event(fd, std::move(s_fn), trigger_mode_);
+}
+
+inline socket_handle event_manager::create_socket_event(int fd, socket_fn s_fn, evt_trigger_mode mode) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    uint32_t events = EPOLLIN;
+    socket_handle h;
+    int ret;
+
+    if (mode == evt_trigger_mode::edge) {
+        events |= EPOLLET;
+    }
+
+    // watched for errors only so far, start watching for reads as well
+    if (error_only_(fd)) {
+        struct epoll_event evt = {};
+
+        evt.events = events;
+        evt.data.u64 = (static_cast<uint64_t>(sources_[fd]->gen_) << 32) | static_cast<uint32_t>(fd);
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &evt) < 0) {
+            return h;
+        }
+    } else {
+        ret = add_source_(fd, events, event_manager_source_type::socket);
+        if (ret < 0) {
+            return h;
+        }
+    }
+
+    sources_[fd]->socket_.fd_ = fd;
+    sources_[fd]->socket_.events_ = events;
+    sources_[fd]->socket_.socket_fn_ = std::move(s_fn);
+    set_sock_busy_poll_(fd);
+
+    h.fd_ = fd;
+    h.gen_ = sources_[fd]->gen_;
+
+    return h;
+}
+
+inline bool event_manager::error_only_(int fd) const
+{
+    if ((fd < 0) || (static_cast<size_t>(fd) >= sources_.size()) || !sources_[fd]) {
+        return false;
+    }
+
+    const event_manager_source &src = *sources_[fd];
+
+    return (src.type_ == event_manager_source_type::socket) && src.socket_.error_fn_ &&
+           !src.socket_.socket_fn_ && !src.socket_.udp_msgs_;
+}
+
+inline int event_manager::set_error_event(int fd, socket_fn fn) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if ((static_cast<size_t>(fd) < sources_.size()) && sources_[fd] &&
+        (sources_[fd]->type_ == event_manager_source_type::socket)) {
+        if (!fn && error_only_(fd)) {
+            remove_source_(fd);
+            return 0;
+        }
+        sources_[fd]->socket_.error_fn_ = std::move(fn);
+        return 0;
+    }
+
+    if (!fn) {
+        return -1;
+    }
+
+    // EPOLLERR and EPOLLHUP are always reported, edge triggered so a hangup fires once
+    if (add_source_(fd, EPOLLET, event_manager_source_type::socket) < 0) {
+        return -1;
+    }
+
+    sources_[fd]->socket_.fd_ = fd;
+    sources_[fd]->socket_.events_ = EPOLLET;
+    sources_[fd]->socket_.error_fn_ = std::move(fn);
+
+    return 0;
+}
+
+inline int event_manager::set_write_event(int fd, socket_fn fn) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if ((fd < 0) || (static_cast<size_t>(fd) >= sources_.size()) || !sources_[fd] ||
+        (sources_[fd]->type_ != event_manager_source_type::socket)) {
+        return -1;
+    }
+
+    sources_[fd]->socket_.write_fn_ = std::move(fn);
+    return 0;
+}
+
+inline int event_manager::arm_write_event(int fd, bool arm) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    struct epoll_event evt = {};
+
+    if ((fd < 0) || (static_cast<size_t>(fd) >= sources_.size()) || !sources_[fd] ||
+        (sources_[fd]->type_ != event_manager_source_type::socket) ||
+        !sources_[fd]->socket_.write_fn_) {
+        return -1;
+    }
+
+    event_manager_source &src = *sources_[fd];
+
+    if (src.socket_.write_armed_ == arm) {
+        return 0;
+    }
+
+    evt.events = src.socket_.events_ | (arm ? (uint32_t)EPOLLOUT : 0u);
+    evt.data.u64 = (static_cast<uint64_t>(src.gen_) << 32) | static_cast<uint32_t>(fd);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &evt) < 0) {
+        return -1;
+    }
+
+    src.socket_.write_armed_ = arm;
+    return 0;
+}
+
+inline socket_handle event_manager::create_udp_batch_event(int fd, udp_msg *msgs, int n_msgs, udp_batch_fn fn) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    socket_handle h;
+
+    if (!msgs || (n_msgs <= 0)) {
+        return h;
+    }
+
+    // level triggered, a socket left with datagrams after the drain budget fires again
+    h = create_socket_event(fd, nullptr, evt_trigger_mode::level);
+    if (!h.valid()) {
+        return h;
+    }
+
+    sources_[fd]->socket_.udp_batch_fn_ = std::move(fn);
+    sources_[fd]->socket_.udp_msgs_ = msgs;
+    sources_[fd]->socket_.udp_n_msgs_ = std::min(n_msgs, udp_batch_max);
+
+    return h;
+}
+
+inline int event_manager::delete_socket_event(int fd) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if ((fd < 0) || (static_cast<size_t>(fd) >= sources_.size()) || !sources_[fd] ||
+        (sources_[fd]->type_ != event_manager_source_type::socket)) {
+        return -1;
+    }
+
+    remove_source_(fd);
+    return 0;
+}
+
+inline int event_manager::delete_socket_event(socket_handle h) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (!h.valid() || (static_cast<size_t>(h.fd_) >= sources_.size()) || !sources_[h.fd_] ||
+        (sources_[h.fd_]->gen_ != h.gen_) ||
+        (sources_[h.fd_]->type_ != event_manager_source_type::socket)) {
+        return -1;
+    }
+
+    remove_source_(h.fd_);
+    return 0;
+}
+
+inline int event_manager::set_deadline(socket_handle h, uint32_t usec) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (!h.valid() || (static_cast<size_t>(h.fd_) >= sources_.size()) || !sources_[h.fd_] ||
+        (sources_[h.fd_]->gen_ != h.gen_) ||
+        (sources_[h.fd_]->type_ != event_manager_source_type::socket)) {
+        return -1;
+    }
+
+    sources_[h.fd_]->deadline_nsec_ = usec * 1000ULL;
+    return 0;
+}
+
+inline int event_manager::set_deadline(timer_handle h, uint32_t usec) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    timer_wheel_node *n = timers_.find(h);
+
+    if (!n) {
+        return -1;
+    }
+
+    n->deadline_ = usec * 1000ULL;
+    if ((usec > 0) && (n->deadline_ < timer_deadline_nsec_)) {
+        timer_deadline_nsec_ = n->deadline_;
+    }
+
+    return 0;
+}
+
+inline int event_manager::get_deadline_misses(socket_handle h, uint64_t &misses) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (!h.valid() || (static_cast<size_t>(h.fd_) >= sources_.size()) || !sources_[h.fd_] ||
+        (sources_[h.fd_]->gen_ != h.gen_) ||
+        (sources_[h.fd_]->type_ != event_manager_source_type::socket)) {
+        return -1;
+    }
+
+    misses = sources_[h.fd_]->deadline_misses_;
+    return 0;
+}
+
+inline int event_manager::get_deadline_misses(timer_handle h, uint64_t &misses) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    timer_wheel_node *n = timers_.find(h);
+
+    if (!n) {
+        return -1;
+    }
+
+    misses = n->deadline_misses_;
+    return 0;
+}
+
+inline int event_manager::create_signal_event(uint32_t sig, signal_fn s_fn) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    int fd;
+    int ret;
+
+    for (auto &it : signals_) {
+        if (it.sig == sig) {
+            it.signal_fn_.push_back(std::move(s_fn));
+            return 0;
+        }
+    }
+
+    sigaddset(&signal_masks_, sig);
+
+    ret = sigprocmask(SIG_BLOCK, &signal_masks_, nullptr);
+    if (ret < 0) {
+        return -1;
+    }
+
+    // an existing signalfd only gets its mask updated
+    fd = signalfd(signal_fd_, &signal_masks_, static_cast<int>(SFD_NONBLOCK) | SFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (signal_fd_ < 0) {
+        signal_fd_ = fd;
+        ret = add_source_(signal_fd_, EPOLLIN, event_manager_source_type::signal);
+        if (ret < 0) {
+            return -1;
+        }
+    }
+
+    event_manager_signal s;
+
+    s.sig = sig;
+    s.signal_fn_.push_back(std::move(s_fn));
+    signals_.push_back(std::move(s));
+
+    return 0;
+}
+
+inline int event_manager::register_term_signals(signal_fn s_fn) noexcept
+{
+    // callbacks are move-only, both signals share the one passed in
+    auto fn = std::make_shared<signal_fn>(std::move(s_fn));
+    int ret;
+
+    ret = create_signal_event(SIGINT, [fn](int sig) { (*fn)(sig); });
+    if (ret < 0) {
+        return -1;
+    }
+
+    return create_signal_event(SIGTERM, [fn](int sig) { (*fn)(sig); });
+}
+
+inline void event_manager::run_execution(job_fn job) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (!p_) {
+        p_ = std::make_unique<thread_pool>();
+    }
+    p_->queue_work(std::move(job));
+}
+
+inline void event_manager::dispatch_timers_()
+{
+    uint64_t expirations;
+
+    if (read(timer_fd_, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        armed_tick_ = UINT64_MAX;
+    }
+
+    timers_.advance(current_tick_());
+    arm_timer_fd_();
+}
+
+inline int event_manager::enable_io_engine(io_engine_type type, uint32_t entries) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    std::shared_ptr<io_engine> io;
+
+    if (io_) {
+        return -1;
+    }
+
+    io = io_engine_factory::instance()->create(type, entries);
+    if (!io) {
+        return -1;
+    }
+
+    if (add_source_(io->get_fd(), EPOLLIN, event_manager_source_type::io) < 0) {
+        return -1;
+    }
+
+    io_ = io;
+    return 0;
+}
+
+inline void event_manager::dispatch_signals_()
+{
+    struct signalfd_siginfo info;
+
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+        for (auto &it : signals_) {
+            if (it.sig != info.ssi_signo) {
+                continue;
+            }
+            for (auto &fn : it.signal_fn_) {
+                uint64_t start = measure_() ? mono_nsec_() : 0;
+
+                fn(info.ssi_signo);
+                if (start) {
+                    record_cb_(stats_.signal_cb_ns_, start, "signal");
+                }
+            }
+        }
+    }
+}
+
+inline uint64_t event_manager::deadline_of_(uint64_t data, uint64_t &now)
+{
+    int fd = static_cast<int>(data & 0xffffffff);
+
+    if ((static_cast<size_t>(fd) >= sources_.size()) || !sources_[fd]) {
+        return UINT64_MAX;
+    }
+
+    event_manager_source &src = *sources_[fd];
+
+    switch (src.type_) {
+        case event_manager_source_type::socket:
+            if (src.deadline_nsec_ == 0) {
+                return UINT64_MAX;
+            }
+            // readiness is observed when epoll_wait returns
+            if (now == 0) {
+                now = mono_nsec_();
+            }
+            return now + src.deadline_nsec_;
+        case event_manager_source_type::timer:
+            // the timers due are at least as urgent as the shortest timer deadline
+            if ((timer_deadline_nsec_ == UINT64_MAX) || (armed_tick_ == UINT64_MAX)) {
+                return UINT64_MAX;
+            }
+            return base_nsec_ + armed_tick_ * tick_usec_ * 1000ULL + timer_deadline_nsec_;
+        default:
+        break;
+    }
+
+    return UINT64_MAX;
+}
+
+inline void event_manager::dispatch_udp_batch_(event_manager_source &src, int fd)
+{
+    uint32_t gen = src.gen_;
+    int n;
+    int i;
+
+    for (i = 0; i < event_manager_udp_drain_batches; i ++) {
+        n = udp_recv_batch(fd, src.socket_.udp_msgs_, src.socket_.udp_n_msgs_, MSG_DONTWAIT);
+        if (n <= 0) {
+            break;
+        }
+
+        if (stats_enabled_) {
+            stats_.udp_batch_size_.record(n);
+        }
+
+        src.socket_.udp_batch_fn_(src.socket_.udp_msgs_, n);
+
+        // a short batch drained the socket, the callback may also have deleted the event
+        if ((n < src.socket_.udp_n_msgs_) || (src.gen_ != gen)) {
+            break;
+        }
+    }
+}
+
+inline void event_manager::dispatch_(uint64_t data, uint64_t deadline, uint32_t events)
+{
+    int fd = static_cast<int>(data & 0xffffffff);
+    uint32_t gen = static_cast<uint32_t>(data >> 32);
+
+    if ((static_cast<size_t>(fd) >= sources_.size()) || !sources_[fd]) {
+        return;
+    }
+
+    event_manager_source &src = *sources_[fd];
+
+    // removed, or removed and registered again by an earlier callback of this batch
+    if (src.gen_ != gen) {
+        return;
+    }
+
+    switch (src.type_) {
+        case event_manager_source_type::socket: {
+            uint64_t start = measure_() ? mono_nsec_() : 0;
+            uint64_t end;
+            uint32_t rd = events & ~EPOLLOUT;
+            bool err = (rd & EPOLLERR) && src.socket_.error_fn_;
+
+            if (err) {
+                src.socket_.error_fn_(fd);
+            }
+
+            // the error callback may have deleted the event
+            if (rd && (!err || (rd & ~EPOLLERR)) && (src.gen_ == gen)) {
+                if (src.socket_.udp_msgs_) {
+                    dispatch_udp_batch_(src, fd);
+                } else if (src.socket_.socket_fn_) {
+                    src.socket_.socket_fn_(fd);
+                }
+            }
+
+            if ((events & EPOLLOUT) && (src.gen_ == gen) && src.socket_.write_armed_) {
+                src.socket_.write_fn_(fd);
+            }
+            if (start) {
+                record_cb_(stats_.socket_cb_ns_, start, "socket");
+            }
+
+            // a callback that deleted its own event has nothing left to account to
+            if ((deadline != UINT64_MAX) && (src.gen_ == gen)) {
+                end = mono_nsec_();
+                if (end > deadline) {
+                    src.deadline_misses_ ++;
+                    stats_.socket_deadline_misses_ ++;
+                    if (log_) {
+                        log_->warning("event_manager: socket %d missed its deadline by %lu usec\n",
+                                      fd, (end - deadline) / 1000);
+                    }
+                }
+            }
+        } break;
+        case event_manager_source_type::timer:
+            dispatch_timers_();
+        break;
+        case event_manager_source_type::signal:
+            dispatch_signals_();
+        break;
+        case event_manager_source_type::io: {
+            uint64_t start = measure_() ? mono_nsec_() : 0;
+
+            io_->reap();
+            if (start) {
+                record_cb_(stats_.io_reap_ns_, start, "io");
+            }
+        } break;
+        case event_manager_source_type::wakeup: {
+            uint64_t val;
+
+            read(wakeup_fd_, &val, sizeof(val));
+            run_posted_();
+        } break;
+        default:
+        break;
+    }
+}
+
+inline void event_manager::set_sock_busy_poll_(int fd)
+{
+    int usec = sock_busy_poll_usec_;
+
+    // fails on anything that is not a socket or without CAP_NET_ADMIN, the fd is still watched
+    if (usec > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+    }
+}
+
+inline int event_manager::enable_busy_poll(uint32_t spin_usec, uint32_t sock_usec, int cpu) noexcept
+{
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if ((cpu < -1) || (cpu >= (int)std::thread::hardware_concurrency())) {
+        return -1;
+    }
+
+    busy_poll_nsec_.store(spin_usec * 1000ULL, std::memory_order_relaxed);
+    busy_poll_cpu_ = cpu;
+
+    sock_busy_poll_usec_ = sock_usec;
+    for (size_t fd = 0; fd < sources_.size(); fd ++) {
+        if (sources_[fd] && (sources_[fd]->type_ == event_manager_source_type::socket)) {
+            set_sock_busy_poll_(fd);
+        }
+    }
+
+    return 0;
+}
+
+inline int event_manager::wait_(struct epoll_event *evts, int &spin_hit)
+{
+    uint64_t budget = busy_poll_nsec_.load(std::memory_order_relaxed);
+    uint64_t until;
+    int ret;
+
+    spin_hit = -1;
+    if (budget == 0) {
+        return epoll_wait(epoll_fd_, evts, event_manager_max_events, -1);
+    }
+
+    // a non blocking epoll_wait keeps the thread off the scheduler's wait queue
+    until = mono_nsec_() + budget;
+    do {
+        ret = epoll_wait(epoll_fd_, evts, event_manager_max_events, 0);
+        if (ret != 0) {
+            spin_hit = (ret > 0);
+            return ret;
+        }
+    } while (!terminate_ && (mono_nsec_() < until));
+
+    spin_hit = 0;
+    return epoll_wait(epoll_fd_, evts, event_manager_max_events, -1);
+}
+
+inline void event_manager::start() noexcept
+{
+    struct epoll_event evts[event_manager_max_events];
+    int spin_hit;
+    int ret;
+    int i;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(lock_);
+
+        if ((busy_poll_cpu_ >= 0) && (set_schedule_cpu(busy_poll_cpu_, pthread_self()) < 0) && log_) {
+            log_->warning("event_manager: failed to pin loop to cpu %d\n", busy_poll_cpu_);
+        }
+    }
+
+    while (!terminate_) {
+        // everything submitted since the last wakeup goes to the kernel at once
+        if (io_) {
+            std::lock_guard<std::recursive_mutex> lock(lock_);
+
+            io_->flush();
+        }
+
+        ret = wait_(evts, spin_hit);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (log_) {
+                log_->error("event_manager: epoll_wait failed %d\n", errno);
+            }
+            break;
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(lock_);
+        uint64_t start = stats_enabled_ ? mono_nsec_() : 0;
+        uint64_t now = start;
+        bool edf = false;
+
+        if (spin_hit > 0) {
+            stats_.busy_poll_hits_ ++;
+        } else if (spin_hit == 0) {
+            stats_.busy_poll_sleeps_ ++;
+        }
+
+        // earliest deadline first, the sort is skipped unless a ready source has a deadline
+        run_queue_.clear();
+        for (i = 0; i < ret; i ++) {
+            event_manager_ready r;
+
+            r.deadline_ = deadline_of_(evts[i].data.u64, now);
+            r.seq_ = i;
+            r.events_ = evts[i].events;
+            r.data_ = evts[i].data.u64;
+            run_queue_.push_back(r);
+
+            edf |= (r.deadline_ != UINT64_MAX);
+        }
+        if (edf) {
+            std::sort(run_queue_.begin(), run_queue_.end());
+        }
+
+        dispatching_ = true;
+        for (auto &it : run_queue_) {
+            dispatch_(it.data_, it.deadline_, it.events_);
+        }
+        dispatching_ = false;
+        retired_.clear();
+
+        if (start && stats_enabled_) {
+            stats_.ready_fds_.record(ret);
+            stats_.loop_iter_ns_.record(mono_nsec_() - start);
+        }
+    }
+}
+
+}
+
+}
+
+#endif
 
@@ -0,0 +1,143 @@
+/**
+ * @brief - implements group of event loops, one per core
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_EVENT_MANAGER_GROUP_H__
+#define __AUTO_LIB_EVENT_MANAGER_GROUP_H__
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <event_manager.h>
+#include <thread_intf.h>
+
+namespace auto_os::lib {
+
+/**
+ * @brief - implements group of independent event managers
+ *
+ * @details - every loop runs on its own thread, callbacks of one loop never
+ *            serialize with the callbacks of another. loop i is pinned to
+ *            cpu i modulo the number of cpus
+ */
+class event_manager_group {
+    public:
+        /**
+         * @brief - create event loops
+         *
+         * @param in n_loops - number of loops, 0 for one per cpu
+         * @param in pin - pin each loop thread to its cpu
+         *
+         * This constructor will throw exception.
+         */
+        explicit event_manager_group(uint32_t n_loops = 0, bool pin = true);
+        ~event_manager_group();
+
+        event_manager_group(const event_manager_group &) = delete;
+        const event_manager_group &operator=(const event_manager_group &) = delete;
+
+        /**
+         * @brief - spawn one thread per loop and run it
+         *
+         * @details - the group is single use, its loops stay terminated once stopped
+         *
+         * @return 0 on success -1 if already started or stopped
+         */
+        int start();
+
+        /**
+         * @brief - terminate all loops and join their threads
+         */
+        void stop();
+
+        /**
+         * @brief - returns loop by index, nullptr if out of range
+         */
+        event_manager *get(uint32_t idx)
+        {
+            if (idx >= loops_.size()) {
+                return nullptr;
+            }
+            return loops_[idx].get();
+        }
+
+        /**
+         * @brief - returns loops in round robin, used to hand off new work
+         */
+        event_manager *next()
+        {
+            return loops_[next_.fetch_add(1, std::memory_order_relaxed) % loops_.size()].get();
+        }
+
+        uint32_t size() const { return loops_.size(); }
+
+    private:
+        std::vector<std::unique_ptr<event_manager>> loops_;
+        std::vector<std::thread> thr_;
+        std::atomic<uint32_t> next_{0};
+        uint32_t n_cpus_;
+        bool pin_;
+        // set by stop(), the loops cannot run again
+        bool stopped_ = false;
+};
+
+inline event_manager_group::event_manager_group(uint32_t n_loops, bool pin) :
+                                                pin_(pin)
+{
+    n_cpus_ = std::thread::hardware_concurrency();
+    if (n_cpus_ == 0) {
+        n_cpus_ = 1;
+    }
+
+    if (n_loops == 0) {
+        n_loops = n_cpus_;
+    }
+
+    for (uint32_t i = 0; i < n_loops; i ++) {
+        loops_.push_back(std::make_unique<event_manager>());
+    }
+}
+
+inline event_manager_group::~event_manager_group()
+{
+    stop();
+}
+
+inline int event_manager_group::start()
+{
+    if (!thr_.empty() || stopped_) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < loops_.size(); i ++) {
+        event_manager *loop = loops_[i].get();
+
+        thr_.emplace_back([loop]() { loop->start(); });
+        if (pin_) {
+            set_schedule_cpu(i % n_cpus_, thr_.back().native_handle());
+        }
+    }
+
+    return 0;
+}
+
+inline void event_manager_group::stop()
+{
+    stopped_ = true;
+    for (auto &it : loops_) {
+        it->terminate();
+    }
+
+    for (auto &it : thr_) {
+        if (it.joinable()) {
+            it.join();
+        }
+    }
+    thr_.clear();
+}
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @brief - implements event_manager latency statistics
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_EVENT_MANAGER_STATS_H__
+#define __AUTO_LIB_EVENT_MANAGER_STATS_H__
+
+#include <cstdint>
+
+namespace auto_os::lib {
+
+// number of power of two buckets of a histogram
+static constexpr int event_manager_histogram_buckets = 40;
+
+/**
+ * @brief - implements log2 histogram
+ *
+ * @details - bucket i counts the values in [2^i, 2^(i + 1)), bucket 0 also counts 0.
+ *            recording is a handful of instructions, no allocation
+ */
+struct event_manager_histogram {
+    uint64_t buckets_[event_manager_histogram_buckets] = {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+
+    void record(uint64_t val)
+    {
+        int b = val ? (63 - __builtin_clzll(val)) : 0;
+
+        if (b >= event_manager_histogram_buckets) {
+            b = event_manager_histogram_buckets - 1;
+        }
+
+        buckets_[b] ++;
+        count_ ++;
+        sum_ += val;
+        if (val > max_) {
+            max_ = val;
+        }
+    }
+
+    uint64_t mean() const { return count_ ? (sum_ / count_) : 0; }
+
+    /**
+     * @brief - add the values recorded by another histogram
+     */
+    void merge(const event_manager_histogram &other)
+    {
+        for (int i = 0; i < event_manager_histogram_buckets; i ++) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (other.max_ > max_) {
+            max_ = other.max_;
+        }
+    }
+
+    /**
+     * @brief - returns upper bound of the bucket holding the given percentile
+     *
+     * @param in pct - percentile, 0 to 100
+     */
+    uint64_t percentile(double pct) const
+    {
+        uint64_t target = (uint64_t)(count_ * pct / 100.0);
+        uint64_t seen = 0;
+
+        for (int i = 0; i < event_manager_histogram_buckets; i ++) {
+            seen += buckets_[i];
+            if ((seen > target) || (seen == count_)) {
+                return (2ULL << i) - 1;
+            }
+        }
+
+        return max_;
+    }
+};
+
+/**
+ * @brief - implements snapshot of event_manager statistics, times in nanoseconds
+ */
+struct event_manager_stats {
+    // run time of each callback by source
+    event_manager_histogram socket_cb_ns_;
+    event_manager_histogram timer_cb_ns_;
+    event_manager_histogram signal_cb_ns_;
+    event_manager_histogram posted_cb_ns_;
+    // run time of one reap of the I/O engine, all its completions
+    event_manager_histogram io_reap_ns_;
+    // time between the expiry of a timer and the start of its callback
+    event_manager_histogram timer_late_ns_;
+    // time to dispatch the events of one wakeup
+    event_manager_histogram loop_iter_ns_;
+    // ready fds returned per wakeup
+    event_manager_histogram ready_fds_;
+    // datagrams per recvmmsg of the udp batch events
+    event_manager_histogram udp_batch_size_;
+    // callbacks that ran longer than the slow callback threshold
+    uint64_t slow_callbacks_ = 0;
+    // callbacks that finished after their deadline, counted even with stats disabled
+    uint64_t socket_deadline_misses_ = 0;
+    uint64_t timer_deadline_misses_ = 0;
+    // busy poll wakeups found while spinning and spins that ran out of budget and slept
+    uint64_t busy_poll_hits_ = 0;
+    uint64_t busy_poll_sleeps_ = 0;
+};
+
+/**
+ * @brief - implements accept statistics of a tcp server
+ */
+struct tcp_accept_stats {
+    // connections accepted
+    uint64_t accepted_ = 0;
+    // accepts failed other than on an empty queue, such as out of fds
+    uint64_t accept_errors_ = 0;
+    // wakeups that found the accept queue full, the kernel drops handshakes meanwhile
+    uint64_t queue_overflows_ = 0;
+    // connections accepted per wakeup
+    event_manager_histogram batch_size_;
+    // connections waiting at each wakeup, sampled with accept stats enabled
+    event_manager_histogram queue_len_;
+    // milliseconds a connection waited to be accepted, sampled with accept stats enabled
+    event_manager_histogram accept_wait_ms_;
+
+    /**
+     * @brief - add the counts of another server, such as another shard
+     */
+    void merge(const tcp_accept_stats &other)
+    {
+        accepted_ += other.accepted_;
+        accept_errors_ += other.accept_errors_;
+        queue_overflows_ += other.queue_overflows_;
+        batch_size_.merge(other.batch_size_);
+        queue_len_.merge(other.queue_len_);
+        accept_wait_ms_.merge(other.accept_wait_ms_);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,455 @@
+/**
+ * @brief - implements C++20 coroutines driven by event_manager
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_EVT_COROUTINE_H__
+#define __AUTO_LIB_EVT_COROUTINE_H__
+
+#if defined(__cpp_impl_coroutine)
+
+#include <cerrno>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+#include <event_manager.h>
+
+namespace auto_os::lib {
+
+// coroutine frames are pooled in size classes of this granularity
+static constexpr size_t evt_coroutine_frame_align = 64;
+
+// frames up to evt_coroutine_frame_align * evt_coroutine_frame_classes bytes are pooled
+static constexpr size_t evt_coroutine_frame_classes = 32;
+
+// free frames kept per size class and thread
+static constexpr size_t evt_coroutine_frame_cache = 64;
+
+/**
+ * @brief - implements per thread pool of coroutine frames
+ *
+ * @details - a frame freed on another thread goes to the pool of that thread,
+ *            in steady state starting a coroutine does not allocate
+ */
+class evt_coroutine_frame_pool {
+    public:
+        /**
+         * @brief - returns pool of the calling thread, nullptr once it is torn down
+         */
+        static evt_coroutine_frame_pool *instance()
+        {
+            static thread_local evt_coroutine_frame_pool pool;
+
+            return alive_() ? &pool : nullptr;
+        }
+
+        evt_coroutine_frame_pool() { alive_() = true; }
+
+        ~evt_coroutine_frame_pool()
+        {
+            // frames freed later in the thread's teardown bypass the pool
+            alive_() = false;
+
+            for (auto &it : free_) {
+                for (auto frame : it) {
+                    ::operator delete(frame);
+                }
+            }
+        }
+
+        void *alloc(size_t size)
+        {
+            size_t cls = (size + evt_coroutine_frame_align - 1) / evt_coroutine_frame_align;
+            void *frame;
+
+            if ((cls >= evt_coroutine_frame_classes) || free_[cls].empty()) {
+                return ::operator new(cls * evt_coroutine_frame_align);
+            }
+
+            frame = free_[cls].back();
+            free_[cls].pop_back();
+            return frame;
+        }
+
+        void free(void *frame, size_t size)
+        {
+            size_t cls = (size + evt_coroutine_frame_align - 1) / evt_coroutine_frame_align;
+
+            if ((cls >= evt_coroutine_frame_classes) || (free_[cls].size() >= evt_coroutine_frame_cache)) {
+                ::operator delete(frame);
+                return;
+            }
+
+            free_[cls].push_back(frame);
+        }
+
+    private:
+        std::vector<void *> free_[evt_coroutine_frame_classes];
+
+        // trivially destructible, still readable after the pool itself is gone
+        static bool &alive_()
+        {
+            static thread_local bool alive = false;
+
+            return alive;
+        }
+};
+
+/**
+ * @brief - implements promise state shared by all evt_task types
+ */
+struct evt_task_promise_base {
+    // coroutine awaiting this one, resumed when it finishes
+    std::coroutine_handle<> cont_;
+    // started with detach, the frame frees itself when it finishes
+    bool detached_ = false;
+    std::exception_ptr ex_;
+
+    struct final_awaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            evt_task_promise_base &p = h.promise();
+
+            if (p.cont_) {
+                return p.cont_;
+            }
+            if (p.detached_) {
+                h.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception()
+    {
+        // nobody is left to see the exception of a detached coroutine
+        if (detached_) {
+            std::terminate();
+        }
+        ex_ = std::current_exception();
+    }
+
+    static void *operator new(size_t size)
+    {
+        evt_coroutine_frame_pool *pool = evt_coroutine_frame_pool::instance();
+
+        return pool ? pool->alloc(size) : ::operator new(size);
+    }
+
+    static void operator delete(void *frame, size_t size)
+    {
+        evt_coroutine_frame_pool *pool = evt_coroutine_frame_pool::instance();
+
+        if (pool) {
+            pool->free(frame, size);
+        } else {
+            ::operator delete(frame);
+        }
+    }
+};
+
+template <typename T>
+struct evt_task_promise : evt_task_promise_base {
+    std::optional<T> val_;
+
+    void return_value(T val) { val_.emplace(std::move(val)); }
+};
+
+template <>
+struct evt_task_promise<void> : evt_task_promise_base {
+    void return_void() noexcept { }
+};
+
+/**
+ * @brief - implements lazily started coroutine
+ *
+ * @details - the coroutine starts when it is awaited or detached. awaiting returns
+ *            the co_return value and rethrows the exception of the coroutine.
+ *            destroying a task suspended in evt_readable or evt_sleep cancels the
+ *            event it waits for, which must happen on the thread running the loop.
+ *            a task awaited on another loop thread must not be destroyed
+ */
+template <typename T = void>
+class evt_task {
+    public:
+        struct promise_type : evt_task_promise<T> {
+            evt_task get_return_object()
+            {
+                return evt_task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+        };
+
+        explicit evt_task() = default;
+        evt_task(evt_task &&other) noexcept : h_(std::exchange(other.h_, nullptr)) { }
+        evt_task &operator=(evt_task &&other) noexcept
+        {
+            if (this != &other) {
+                destroy_();
+                h_ = std::exchange(other.h_, nullptr);
+            }
+            return *this;
+        }
+
+        evt_task(const evt_task &) = delete;
+        evt_task &operator=(const evt_task &) = delete;
+
+        ~evt_task() { destroy_(); }
+
+        /**
+         * @brief - start the coroutine and let it run on its own
+         *
+         * @details - the frame is freed when the coroutine finishes, an exception
+         *            escaping a detached coroutine terminates the process
+         */
+        void detach()
+        {
+            std::coroutine_handle<promise_type> h = std::exchange(h_, nullptr);
+
+            if (h) {
+                h.promise().detached_ = true;
+                h.resume();
+            }
+        }
+
+        /**
+         * @brief - returns true once the coroutine has finished
+         */
+        bool done() const { return !h_ || h_.done(); }
+
+        bool await_ready() const noexcept { return !h_ || h_.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept
+        {
+            h_.promise().cont_ = cont;
+            return h_;
+        }
+
+        T await_resume()
+        {
+            if (h_.promise().ex_) {
+                std::rethrow_exception(h_.promise().ex_);
+            }
+
+            if constexpr (!std::is_void_v<T>) {
+                return std::move(*h_.promise().val_);
+            }
+        }
+
+    private:
+        explicit evt_task(std::coroutine_handle<promise_type> h) : h_(h) { }
+
+        void destroy_()
+        {
+            if (h_) {
+                h_.destroy();
+                h_ = nullptr;
+            }
+        }
+
+        std::coroutine_handle<promise_type> h_;
+};
+
+/**
+ * @brief - implements awaitable that resumes when a fd turns readable
+ *
+ * @details - co_await returns true once readable, false on timeout or if the fd
+ *            could not be watched. the coroutine is resumed on the loop thread
+ */
+class evt_readable {
+    public:
+        /**
+         * @brief - wait for fd
+         *
+         * @param in evt_mgr - event manager driving the coroutine
+         * @param in fd - fd to wait for
+         * @param in timeout_msec - give up after this many milliseconds, -1 to wait forever
+         */
+        explicit evt_readable(event_manager *evt_mgr, int fd, int timeout_msec = -1) :
+                              evt_mgr_(evt_mgr), fd_(fd), timeout_msec_(timeout_msec) { }
+
+        // the frame of a suspended coroutine was destroyed, nothing may resume it
+        ~evt_readable() { cancel_(); }
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            h_ = h;
+
+            sock_ = evt_mgr_->create_socket_event(fd_, [this](int) { complete_(true); });
+            if (!sock_.valid()) {
+                return false;
+            }
+
+            if (timeout_msec_ >= 0) {
+                timer_ = evt_mgr_->create_timer_event(true, timeout_msec_ / 1000,
+                                                      (timeout_msec_ % 1000) * 1000,
+                                                      [this]() { complete_(false); });
+            }
+
+            suspended_ = true;
+            return true;
+        }
+
+        bool await_resume() const noexcept { return ready_; }
+
+    private:
+        event_manager *evt_mgr_;
+        int fd_;
+        int timeout_msec_;
+        bool ready_ = false;
+        bool suspended_ = false;
+        std::coroutine_handle<> h_;
+        socket_handle sock_;
+        timer_handle timer_;
+
+        void cancel_()
+        {
+            if (!suspended_) {
+                return;
+            }
+
+            evt_mgr_->delete_socket_event(sock_);
+            if (timer_.valid()) {
+                evt_mgr_->delete_timer_event(timer_);
+            }
+            suspended_ = false;
+        }
+
+        void complete_(bool ready)
+        {
+            cancel_();
+
+            ready_ = ready;
+            h_.resume();
+        }
+};
+
+/**
+ * @brief - implements awaitable that runs an operation once a fd turns readable
+ *
+ * @details - co_await returns the result of the operation, -1 with errno set to
+ *            ETIMEDOUT on timeout
+ */
+template <typename Op>
+class evt_readable_op : public evt_readable {
+    public:
+        explicit evt_readable_op(event_manager *evt_mgr, int fd, int timeout_msec, Op op) :
+                                 evt_readable(evt_mgr, fd, timeout_msec), op_(std::move(op)) { }
+
+        int await_resume()
+        {
+            if (!evt_readable::await_resume()) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            return op_();
+        }
+
+    private:
+        Op op_;
+};
+
+/**
+ * @brief - implements awaitable that resumes after a delay
+ */
+class evt_sleep {
+    public:
+        explicit evt_sleep(event_manager *evt_mgr, int msec) : evt_mgr_(evt_mgr), msec_(msec) { }
+
+        // the frame of a suspended coroutine was destroyed, nothing may resume it
+        ~evt_sleep()
+        {
+            if (suspended_) {
+                evt_mgr_->delete_timer_event(timer_);
+            }
+        }
+
+        bool await_ready() const noexcept { return msec_ <= 0; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            timer_ = evt_mgr_->create_timer_event(true, msec_ / 1000, (msec_ % 1000) * 1000,
+                                                  [this, h]() {
+                suspended_ = false;
+                h.resume();
+            });
+            suspended_ = timer_.valid();
+
+            return suspended_;
+        }
+
+        void await_resume() const noexcept { }
+
+    private:
+        event_manager *evt_mgr_;
+        int msec_;
+        bool suspended_ = false;
+        timer_handle timer_;
+};
+
+// awaitable factories, kept apart so that they do not hide ::recv and friends
+namespace co {
+
+/**
+ * @brief - co_await co::readable(evt_mgr, fd) - wait for fd to be readable
+ */
+inline evt_readable readable(event_manager *evt_mgr, int fd, int timeout_msec = -1)
+{
+    return evt_readable(evt_mgr, fd, timeout_msec);
+}
+
+/**
+ * @brief - co_await co::sleep_for(evt_mgr, msec) - resume after msec milliseconds
+ */
+inline evt_sleep sleep_for(event_manager *evt_mgr, int msec)
+{
+    return evt_sleep(evt_mgr, msec);
+}
+
+/**
+ * @brief - co_await co::recv(evt_mgr, conn, buf, len) - receive once conn is readable
+ *
+ * @details - conn is any connection with get_socket and recv_msg(data, data_len),
+ *            such as tcp_conn, tcp_client, unix_tcp_conn or unix_tcp_client
+ */
+template <typename Conn>
+inline auto recv(event_manager *evt_mgr, Conn &conn, uint8_t *buf, size_t len, int timeout_msec = -1)
+{
+    auto op = [&conn, buf, len]() { return conn.recv_msg(buf, len); };
+
+    return evt_readable_op<decltype(op)>(evt_mgr, conn.get_socket(), timeout_msec, op);
+}
+
+/**
+ * @brief - co_await co::recv_from(evt_mgr, conn, addr, port, buf, len) - receive a datagram
+ *
+ * @details - conn is udp_server or udp_client
+ */
+template <typename Conn>
+inline auto recv_from(event_manager *evt_mgr, Conn &conn, std::string &addr, int &port,
+                      uint8_t *buf, size_t len, int timeout_msec = -1)
+{
+    auto op = [&conn, &addr, &port, buf, len]() { return conn.recv_msg(addr, port, buf, len); };
+
+    return evt_readable_op<decltype(op)>(evt_mgr, conn.get_socket(), timeout_msec, op);
+}
+
+}
+
+}
+
+#endif
+
+#endif
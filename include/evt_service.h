@@ -1,29 +1,130 @@
+
+
 #ifndef __AUTO_LIB_EVT_SERVICE_H__
 #define __AUTO_LIB_EVT_SERVICE_H__
 
 #include <vector>
 #include <memory>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <socket_api.h>
 #include <event_manager.h>
+#include <frame_reader.h>
+#include <rx_buffer_pool.h>
 
 namespace auto_os::lib {
 
 
 typedef std::function<void(int fd, uint8_t *buff, size_t buff_size)> on_receive;
 
+// called with each complete frame, the frame is valid during the call only
+typedef std::function<void(int fd, const uint8_t *frame, size_t frame_len)> on_frame;
+
+// called with each chunk received into a pool buffer, copy or move buf to keep it past the call
+typedef std::function<void(int fd, rx_buffer &buf)> on_receive_buf;
 
-struct tcp_conn_context;
+// size of the receive buffer of a connection
+static constexpr size_t evt_tcp_service_rx_buf_size = 4096;
+
+// connections accepted per wakeup, the rest waits for the next one
+static constexpr int evt_tcp_service_accept_batch = 64;
+
+/**
+ * @brief - implements evt_tcp_service connection
+ */
+struct tcp_conn_context {
+    std::unique_ptr<tcp_conn> conn_;
+    std::vector<uint8_t> rx_buf_;
+    // set when frames are delivered instead of raw chunks
+    std::unique_ptr<frame_reader> reader_;
+    // pool buffer of the read pending on the I/O engine
+    rx_buffer pending_;
+};
 
 class evt_tcp_service {
     public:
         explicit evt_tcp_service(auto_os::lib::event_manager *evt_mgr,
                                  std::string ipaddr, int port, int n_conn);
+
+        /**
+         * @brief - create tcp service
+         *
+         * @param in evt_mgr - event manager instance
+         * @param in ipaddr - ipaddress of the service
+         * @param in port - port of the service
+         * @param in n_conn - number of connections
+         * @param in use_io_engine - accept and receive through the I/O engine of
+         *                           the event manager, it must have one enabled
+         *
+         * This constructor will throw exception.
+         */
+        explicit evt_tcp_service(auto_os::lib::event_manager *evt_mgr,
+                                 std::string ipaddr, int port, int n_conn,
+                                 bool use_io_engine);
         ~evt_tcp_service();
 
         void register_on_receive(on_receive cb) { on_rx_cb_ = cb; }
 
+        /**
+         * @brief - deliver complete frames instead of raw chunks
+         *
+         * @param in proto - reader set up with the framing, copied for every new connection
+         * @param in cb - called with each frame
+         *
+         * @details - a connection sending a malformed or oversized frame is closed
+         */
+        void register_on_frame(const frame_reader &proto, on_frame cb)
+        {
+            frame_proto_ = std::make_unique<frame_reader>(proto);
+            on_frame_cb_ = cb;
+        }
+
+        /**
+         * @brief - receive into buffers of a pool shared with other services
+         *
+         * @param in pool - pool, must outlive the service and the buffers kept by the callbacks
+         *
+         * @details - call before any connection is accepted. a connection holds no buffer
+         *            while idle, except for the one of its pending read on the I/O engine
+         */
+        void set_rx_buffer_pool(std::shared_ptr<rx_buffer_pool> pool) { pool_ = pool; }
+
+        /**
+         * @brief - receive chunks as pool buffers that may be kept past the callback
+         *
+         * @param in cb - called with each chunk, replaces the on_receive callback
+         *
+         * @details - a pool is created if none is set, its buffers must be released
+         *            before the service is destroyed
+         */
+        void register_on_receive_buf(on_receive_buf cb)
+        {
+            on_rx_buf_cb_ = cb;
+            if (!pool_) {
+                pool_ = std::make_shared<rx_buffer_pool>(evt_tcp_service_rx_buf_size);
+            }
+        }
+
+        /**
+         * @brief - returns accept statistics, call from the loop thread or once it stopped
+         *
+         * @details - the queue samples are not taken by the service
+         */
+        tcp_accept_stats get_accept_stats() const { return accept_stats_; }
+
     private:
         void accept_conns(int fd);
+        void add_conn_(int fd);
+        void receive_(int fd);
+        int deliver_frames_(tcp_conn_context *ctx);
+        void remove_conn_(int fd);
+        tcp_conn_context *find_conn_(int fd);
+        void submit_accept_();
+        void submit_read_(int fd);
+        void deliver_buf_(int fd, rx_buffer &buf);
         std::string  ipaddr_;
         int port_;
         int n_conn_;
@@ -31,10 +132,361 @@ class evt_tcp_service {
         auto_os::lib::event_manager *evt_mgr_;
         std::vector<tcp_conn_context> conn_list_;
         on_receive on_rx_cb_;
+        std::unique_ptr<frame_reader> frame_proto_;
+        on_frame on_frame_cb_;
+        std::shared_ptr<rx_buffer_pool> pool_;
+        on_receive_buf on_rx_buf_cb_;
+        io_engine *io_ = nullptr;
+        tcp_accept_stats accept_stats_;
+        // completions of the I/O engine may arrive after the service is gone
+        std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
 };
 
+inline evt_tcp_service::evt_tcp_service(auto_os::lib::event_manager *evt_mgr,
+                                        std::string ipaddr, int port, int n_conn) :
+                                        evt_tcp_service(evt_mgr, ipaddr, port, n_conn, false)
+{
 }
 
-#endif
+inline evt_tcp_service::evt_tcp_service(auto_os::lib::event_manager *evt_mgr,
+                                        std::string ipaddr, int port, int n_conn,
+                                        bool use_io_engine) :
+                                        ipaddr_(ipaddr),
+                                        port_(port),
+                                        n_conn_(n_conn),
+                                        evt_mgr_(evt_mgr)
+{
+    tcp_serv_ = std::make_unique<tcp_server>(ipaddr, port, n_conn);
+
+    // the accept queue is drained until empty on each wakeup. the I/O engine needs it too,
+    // the epoll engine accepts on readiness and the connection may be reset by then
+    fcntl(tcp_serv_->get_socket(), F_SETFL, fcntl(tcp_serv_->get_socket(), F_GETFL) | O_NONBLOCK);
+
+    if (use_io_engine) {
+        io_ = evt_mgr_->get_io_engine();
+        if (!io_) {
+            throw std::runtime_error("event manager has no I/O engine");
+        }
+        submit_accept_();
+        return;
+    }
+
+    evt_mgr_->create_socket_event(tcp_serv_->get_socket(),
+                                  std::bind(&evt_tcp_service::accept_conns,
+                                            this, std::placeholders::_1));
+}
+
+inline evt_tcp_service::~evt_tcp_service()
+{
+    // clearing the list closes the sockets, their pending reads complete with -ECANCELED
+    for (auto &it : conn_list_) {
+        if (io_) {
+            io_->cancel_fd(it.conn_->get_socket());
+        } else {
+            evt_mgr_->delete_socket_event(it.conn_->get_socket());
+        }
+    }
+    conn_list_.clear();
+
+    if (io_) {
+        io_->cancel_fd(tcp_serv_->get_socket());
+    } else {
+        evt_mgr_->delete_socket_event(tcp_serv_->get_socket());
+    }
+}
+
+inline tcp_conn_context *evt_tcp_service::find_conn_(int fd)
+{
+    for (auto &it : conn_list_) {
+        if (it.conn_->get_socket() == fd) {
+            return &it;
+        }
+    }
+
+    return nullptr;
+}
+
+inline void evt_tcp_service::add_conn_(int fd)
+{
+    struct sockaddr_in addr = {};
+    socklen_t addr_len = sizeof(addr);
+    char ip[INET_ADDRSTRLEN];
+    tcp_conn_context ctx;
+
+    getpeername(fd, (struct sockaddr *)&addr, &addr_len);
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+
+    ctx.conn_ = std::make_unique<tcp_conn>(fd, ip, ntohs(addr.sin_port));
+    if (frame_proto_) {
+        ctx.reader_ = std::make_unique<frame_reader>(*frame_proto_);
+    } else if (!pool_) {
+        ctx.rx_buf_.resize(evt_tcp_service_rx_buf_size);
+    }
+    conn_list_.push_back(std::move(ctx));
+}
+
+inline void evt_tcp_service::accept_conns(int fd)
+{
+    int n_accepted = 0;
+    int conn_fd;
+
+    while (n_accepted < evt_tcp_service_accept_batch) {
+        conn_fd = accept4(fd, nullptr, nullptr, static_cast<int>(SOCK_NONBLOCK) | SOCK_CLOEXEC);
+        if (conn_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                accept_stats_.accept_errors_ ++;
+            }
+            break;
+        }
+
+        n_accepted ++;
+        accept_stats_.accepted_ ++;
+        add_conn_(conn_fd);
+
+        if (!evt_mgr_->create_socket_event(conn_fd,
+                            std::bind(&evt_tcp_service::receive_,
+                                      this, std::placeholders::_1)).valid()) {
+            remove_conn_(conn_fd);
+        }
+    }
+
+    accept_stats_.batch_size_.record(n_accepted);
+}
+
+inline void evt_tcp_service::receive_(int fd)
+{
+    tcp_conn_context *ctx = find_conn_(fd);
+    int ret;
+
+    if (!ctx) {
+        return;
+    }
+
+    if (ctx->reader_) {
+        ret = ctx->reader_->read_from(fd);
+        if ((ret < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+            return;
+        }
+        if ((ret <= 0) || (deliver_frames_(ctx) < 0)) {
+            remove_conn_(fd);
+        }
+        return;
+    }
+
+    if (pool_) {
+        rx_buffer buf = pool_->get();
+
+        ret = buf.valid() ? recv(fd, buf.data(), buf.capacity(), 0) : -1;
+        if ((ret < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+            return;
+        }
+        if (ret <= 0) {
+            remove_conn_(fd);
+            return;
+        }
+
+        buf.set_size(ret);
+        deliver_buf_(fd, buf);
+        return;
+    }
+
+    ret = ctx->conn_->recv_msg(ctx->rx_buf_.data(), ctx->rx_buf_.size());
+    if ((ret < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+        return;
+    }
+    if (ret <= 0) {
+        remove_conn_(fd);
+        return;
+    }
+
+    if (on_rx_cb_) {
+        on_rx_cb_(fd, ctx->rx_buf_.data(), ret);
+    }
+}
 
+inline void evt_tcp_service::deliver_buf_(int fd, rx_buffer &buf)
+{
+    if (on_rx_buf_cb_) {
+        on_rx_buf_cb_(fd, buf);
+    } else if (on_rx_cb_) {
+        on_rx_cb_(fd, buf.data(), buf.size());
+    }
+}
+
+inline int evt_tcp_service::deliver_frames_(tcp_conn_context *ctx)
+{
+    int fd = ctx->conn_->get_socket();
+    // owned through a unique_ptr, stays put when conn_list_ moves its contexts
+    frame_reader *reader = ctx->reader_.get();
+    frame_view frame;
+    int ret;
+
+    // drained until empty, nothing reads the socket again before more data arrives
+    while ((ret = reader->next(frame)) > 0) {
+        if (on_frame_cb_) {
+            on_frame_cb_(fd, frame.data_, frame.len_);
+        }
+
+        // the callback may have closed this connection, its frames go with it. closing
+        // another one only moves this context within conn_list_
+        if (!find_conn_(fd)) {
+            return 0;
+        }
+    }
+
+    return ret;
+}
+
+inline void evt_tcp_service::remove_conn_(int fd)
+{
+    for (auto it = conn_list_.begin(); it != conn_list_.end(); it ++) {
+        if (it->conn_->get_socket() == fd) {
+            if (io_) {
+                io_->cancel_fd(fd);
+            } else {
+                evt_mgr_->delete_socket_event(fd);
+            }
+            conn_list_.erase(it);
+            return;
+        }
+    }
+}
+
+inline void evt_tcp_service::submit_accept_()
+{
+    std::weak_ptr<bool> alive = alive_;
+
+    io_->submit_accept(tcp_serv_->get_socket(), [this, alive](int res) {
+        if (alive.expired()) {
+            if (res >= 0) {
+                close(res);
+            }
+            return;
+        }
+
+        if (res >= 0) {
+            accept_stats_.accepted_ ++;
+            accept_stats_.batch_size_.record(1);
+            add_conn_(res);
+            submit_read_(res);
+        } else if (res != -EINTR) {
+            accept_stats_.accept_errors_ ++;
+        }
+
+        submit_accept_();
+    });
+}
+
+inline void evt_tcp_service::submit_read_(int fd)
+{
+    tcp_conn_context *ctx = find_conn_(fd);
+    std::weak_ptr<bool> alive = alive_;
+
+    if (!ctx) {
+        return;
+    }
+
+    // frames are read straight into the free space of the reader
+    if (ctx->reader_) {
+        size_t len;
+        uint8_t *space = ctx->reader_->prepare(len);
+
+        if (!space) {
+            remove_conn_(fd);
+            return;
+        }
+
+        io_->submit_read(fd, space, len, [this, alive, fd](int res) {
+            tcp_conn_context *ctx;
+
+            if (alive.expired() || (res == -ECANCELED)) {
+                return;
+            }
+
+            ctx = find_conn_(fd);
+            if (!ctx) {
+                return;
+            }
+
+            if (res <= 0) {
+                remove_conn_(fd);
+                return;
+            }
+
+            ctx->reader_->commit(res);
+            if (deliver_frames_(ctx) < 0) {
+                remove_conn_(fd);
+                return;
+            }
+
+            submit_read_(fd);
+        });
+        return;
+    }
+
+    if (pool_) {
+        ctx->pending_ = pool_->get();
+        if (!ctx->pending_.valid()) {
+            remove_conn_(fd);
+            return;
+        }
+
+        io_->submit_read(fd, ctx->pending_.data(), ctx->pending_.capacity(), [this, alive, fd](int res) {
+            tcp_conn_context *ctx;
+            rx_buffer buf;
+
+            if (alive.expired() || (res == -ECANCELED)) {
+                return;
+            }
+
+            ctx = find_conn_(fd);
+            if (!ctx) {
+                return;
+            }
+
+            if (res <= 0) {
+                remove_conn_(fd);
+                return;
+            }
+
+            buf = std::move(ctx->pending_);
+            buf.set_size(res);
+            deliver_buf_(fd, buf);
+
+            submit_read_(fd);
+        });
+        return;
+    }
+
+    io_->submit_read(fd, ctx->rx_buf_.data(), ctx->rx_buf_.size(), [this, alive, fd](int res) {
+        tcp_conn_context *ctx;
+
+        if (alive.expired() || (res == -ECANCELED)) {
+            return;
+        }
+
+        ctx = find_conn_(fd);
+        if (!ctx) {
+            return;
+        }
+
+        if (res <= 0) {
+            remove_conn_(fd);
+            return;
+        }
+
+        if (on_rx_cb_) {
+            on_rx_cb_(fd, ctx->rx_buf_.data(), res);
+        }
+
+        submit_read_(fd);
+    });
+}
+
+}
+
+#endif
 
@@ -0,0 +1,332 @@
+/**
+ * @brief - implements buffered reader of framed messages on a stream
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_FRAME_READER_H__
+#define __AUTO_LIB_FRAME_READER_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+
+namespace auto_os::lib {
+
+// bytes buffered per connection by default, also the largest frame
+static constexpr size_t frame_reader_default_max_buffered = 65536;
+
+/**
+ * @brief - how frames are cut out of the stream
+ */
+enum class frame_format {
+    // frame is a length field followed by that many bytes
+    length_prefixed,
+    // frame ends with a delimiter
+    delimited,
+    // frame length is found by a decoder
+    custom,
+};
+
+/**
+ * @brief - returns length of the frame at the start of data, 0 if incomplete, -1 if malformed
+ *
+ * @details - the frame handed out is the first n bytes as returned
+ */
+typedef std::function<int(const uint8_t *data, size_t data_len)> frame_decoder;
+
+/**
+ * @brief - implements view of a complete frame inside the reader's buffer
+ */
+struct frame_view {
+    const uint8_t *data_ = nullptr;
+    size_t len_ = 0;
+};
+
+/**
+ * @brief - implements framed message reader
+ *
+ * @details - the stream is read in large chunks into one buffer of twice the
+ *            bound, frames are handed out as views into it. consumed bytes are
+ *            reclaimed by moving the unread tail to the front once the free
+ *            space runs low, so a view stays valid until the next read
+ */
+class frame_reader {
+    public:
+        /**
+         * @brief - create reader
+         *
+         * @param in max_buffered - bound of the unread bytes, also the largest frame
+         */
+        explicit frame_reader(size_t max_buffered = frame_reader_default_max_buffered) :
+                              max_buffered_(max_buffered) { }
+        ~frame_reader() = default;
+
+        /**
+         * @brief - copy the framing of another reader, none of its buffered bytes
+         */
+        frame_reader(const frame_reader &other) :
+                     max_buffered_(other.max_buffered_),
+                     format_(other.format_),
+                     prefix_bytes_(other.prefix_bytes_),
+                     big_endian_(other.big_endian_),
+                     includes_prefix_(other.includes_prefix_),
+                     delim_(other.delim_),
+                     decoder_(other.decoder_) { }
+
+        frame_reader &operator=(const frame_reader &) = delete;
+
+        /**
+         * @brief - frames are a big or little endian length field and the payload
+         *
+         * @param in prefix_bytes - size of the length field, 1, 2 or 4
+         * @param in big_endian - byte order of the length field
+         * @param in includes_prefix - true if the length counts the length field itself
+         *
+         * @details - the view handed out is the payload, without the length field
+         *
+         * @return 0 on success -1 on invalid length field size
+         */
+        int set_length_prefixed(int prefix_bytes, bool big_endian = true, bool includes_prefix = false)
+        {
+            if ((prefix_bytes != 1) && (prefix_bytes != 2) && (prefix_bytes != 4)) {
+                return -1;
+            }
+
+            format_ = frame_format::length_prefixed;
+            prefix_bytes_ = prefix_bytes;
+            big_endian_ = big_endian;
+            includes_prefix_ = includes_prefix;
+            return 0;
+        }
+
+        /**
+         * @brief - frames end with a delimiter, such as "\r\n"
+         *
+         * @details - the view handed out excludes the delimiter
+         *
+         * @return 0 on success -1 on empty delimiter
+         */
+        int set_delimiter(const std::string &delim)
+        {
+            if (delim.empty()) {
+                return -1;
+            }
+
+            format_ = frame_format::delimited;
+            delim_ = delim;
+            return 0;
+        }
+
+        /**
+         * @brief - frames are cut by a decoder
+         */
+        void set_decoder(frame_decoder decoder)
+        {
+            format_ = frame_format::custom;
+            decoder_ = std::move(decoder);
+        }
+
+        /**
+         * @brief - returns free space to read into, nullptr if the bound is reached
+         *
+         * @param out len - bytes free
+         *
+         * @details - for readers that fill the buffer themselves, such as the I/O engine.
+         *            invalidates the views handed out so far
+         */
+        uint8_t *prepare(size_t &len);
+
+        /**
+         * @brief - account bytes written into the space returned by prepare
+         */
+        void commit(size_t len) { tail_ += len; }
+
+        /**
+         * @brief - read once from a socket into the buffer
+         *
+         * @param in fd - stream socket
+         *
+         * @details - invalidates the views handed out so far
+         *
+         * @return bytes read, 0 on peer close, -1 on failure, errno ENOBUFS if the bound is reached
+         */
+        int read_from(int fd);
+
+        /**
+         * @brief - get the next complete frame
+         *
+         * @param out frame - view of the frame, valid until the next read
+         *
+         * @return 1 if a frame is returned, 0 if more bytes are needed,
+         *         -1 on malformed stream or frame larger than the bound
+         */
+        int next(frame_view &frame);
+
+        /**
+         * @brief - returns number of unread bytes
+         */
+        size_t buffered() const { return tail_ - head_; }
+
+    private:
+        size_t max_buffered_;
+        frame_format format_ = frame_format::length_prefixed;
+        int prefix_bytes_ = 4;
+        bool big_endian_ = true;
+        bool includes_prefix_ = false;
+        std::string delim_;
+        frame_decoder decoder_;
+
+        std::unique_ptr<uint8_t[]> buf_;
+        size_t head_ = 0;
+        size_t tail_ = 0;
+        // where the delimiter search resumes, bytes before it were searched already
+        size_t scanned_ = 0;
+
+        size_t capacity_() const { return max_buffered_ * 2; }
+        void consume_(size_t len);
+};
+
+inline uint8_t *frame_reader::prepare(size_t &len)
+{
+    if (!buf_) {
+        buf_ = std::make_unique<uint8_t[]>(capacity_());
+    }
+
+    // the unread bytes move to the front once they would not fit behind the tail
+    if ((head_ > 0) && (capacity_() - tail_ < max_buffered_)) {
+        memmove(buf_.get(), buf_.get() + head_, tail_ - head_);
+        tail_ -= head_;
+        scanned_ -= head_;
+        head_ = 0;
+    }
+
+    len = std::min(capacity_() - tail_, max_buffered_ - buffered());
+    if (len == 0) {
+        return nullptr;
+    }
+
+    return buf_.get() + tail_;
+}
+
+inline int frame_reader::read_from(int fd)
+{
+    uint8_t *space;
+    size_t len;
+    int ret;
+
+    space = prepare(len);
+    if (!space) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ret = recv(fd, space, len, 0);
+    if (ret > 0) {
+        commit(ret);
+    }
+
+    return ret;
+}
+
+inline void frame_reader::consume_(size_t len)
+{
+    head_ += len;
+    scanned_ = head_;
+
+    if (head_ == tail_) {
+        head_ = 0;
+        tail_ = 0;
+        scanned_ = 0;
+    }
+}
+
+inline int frame_reader::next(frame_view &frame)
+{
+    const uint8_t *data = buf_.get() + head_;
+    size_t avail = buffered();
+    size_t len = 0;
+    size_t frame_len;
+    int ret;
+
+    if (avail == 0) {
+        return 0;
+    }
+
+    switch (format_) {
+        case frame_format::length_prefixed:
+            if (avail < (size_t)prefix_bytes_) {
+                return 0;
+            }
+
+            for (int i = 0; i < prefix_bytes_; i ++) {
+                int b = big_endian_ ? i : (prefix_bytes_ - 1 - i);
+
+                len = (len << 8) | data[b];
+            }
+            if (includes_prefix_) {
+                if (len < (size_t)prefix_bytes_) {
+                    return -1;
+                }
+                len -= prefix_bytes_;
+            }
+            if (prefix_bytes_ + len > max_buffered_) {
+                return -1;
+            }
+            if (avail < prefix_bytes_ + len) {
+                return 0;
+            }
+
+            frame.data_ = data + prefix_bytes_;
+            frame.len_ = len;
+            consume_(prefix_bytes_ + len);
+        break;
+        case frame_format::delimited: {
+            const uint8_t *from = buf_.get() + std::max(scanned_, head_);
+            const uint8_t *end = buf_.get() + tail_;
+            const uint8_t *found = static_cast<const uint8_t *>(
+                        memmem(from, end - from, delim_.data(), delim_.size()));
+
+            if (!found) {
+                // a delimiter may straddle the bytes still to come
+                scanned_ = (avail >= delim_.size()) ? (tail_ - delim_.size() + 1) : head_;
+                return (avail >= max_buffered_) ? -1 : 0;
+            }
+
+            frame_len = found - data;
+            frame.data_ = data;
+            frame.len_ = frame_len;
+            consume_(frame_len + delim_.size());
+        } break;
+        case frame_format::custom:
+            if (!decoder_) {
+                return -1;
+            }
+
+            ret = decoder_(data, avail);
+            if (ret < 0) {
+                return -1;
+            }
+            if (ret == 0) {
+                return (avail >= max_buffered_) ? -1 : 0;
+            }
+            if ((size_t)ret > avail) {
+                return -1;
+            }
+
+            frame.data_ = data;
+            frame.len_ = ret;
+            consume_(ret);
+        break;
+    }
+
+    return 1;
+}
+
+}
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @brief - implements move-only callable with inline storage
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_INLINE_FN_H__
+#define __AUTO_LIB_INLINE_FN_H__
+
+#include <cstddef>
+#include <new>
+#include <typeinfo>
+#include <type_traits>
+#include <utility>
+
+namespace auto_os::lib {
+
+// bytes of captures stored without allocation, an inline_fn is then 64 bytes
+static constexpr size_t inline_fn_default_capacity = 48;
+
+template <typename Sig, size_t Capacity = inline_fn_default_capacity>
+class inline_fn;
+
+/**
+ * @brief - implements move-only callable with inline storage
+ *
+ * @details - a callable up to Capacity bytes is stored in place, larger ones are
+ *            allocated on the heap. with CONFIG_INLINE_FN_STRICT defined a callable
+ *            that does not fit fails to compile instead
+ */
+template <typename R, typename... Args, size_t Capacity>
+class inline_fn<R(Args...), Capacity> {
+    public:
+        inline_fn() noexcept { }
+        inline_fn(std::nullptr_t) noexcept { }
+
+        template <typename F,
+                  typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, inline_fn> &&
+                                              std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>>
+        inline_fn(F &&fn)
+        {
+            typedef std::decay_t<F> T;
+
+            if constexpr (std::is_pointer_v<T> || std::is_member_pointer_v<T>) {
+                if (!fn) {
+                    return;
+                }
+            }
+
+            if constexpr (fits_<T>()) {
+                new (storage_) T(std::forward<F>(fn));
+                invoke_ = &invoke_inline_<T>;
+                manage_ = &manage_inline_<T>;
+            } else {
+#if defined(CONFIG_INLINE_FN_STRICT)
+                static_assert(fits_<T>(), "callable does not fit in inline_fn storage");
+#endif
+                *reinterpret_cast<T **>(storage_) = new T(std::forward<F>(fn));
+                invoke_ = &invoke_heap_<T>;
+                manage_ = &manage_heap_<T>;
+            }
+        }
+
+        inline_fn(inline_fn &&other) noexcept
+        {
+            move_from_(other);
+        }
+
+        inline_fn &operator=(inline_fn &&other) noexcept
+        {
+            if (this != &other) {
+                reset_();
+                move_from_(other);
+            }
+            return *this;
+        }
+
+        inline_fn &operator=(std::nullptr_t) noexcept
+        {
+            reset_();
+            return *this;
+        }
+
+        inline_fn(const inline_fn &) = delete;
+        inline_fn &operator=(const inline_fn &) = delete;
+
+        ~inline_fn() { reset_(); }
+
+        explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+        R operator()(Args... args) const
+        {
+            return invoke_(storage_, std::forward<Args>(args)...);
+        }
+
+        /**
+         * @brief - returns type of the stored callable, typeid(void) if empty
+         */
+        const std::type_info &target_type() const noexcept
+        {
+            if (!manage_) {
+                return typeid(void);
+            }
+            return *static_cast<const std::type_info *>(manage_(op::type, storage_, nullptr));
+        }
+
+        /**
+         * @brief - returns the stored callable, nullptr if it is not a T
+         */
+        template <typename T>
+        T *target() const noexcept
+        {
+            if (!manage_ || (target_type() != typeid(T))) {
+                return nullptr;
+            }
+            return static_cast<T *>(const_cast<void *>(static_cast<const void *>(
+                        manage_(op::get, storage_, nullptr))));
+        }
+
+    private:
+        enum class op {
+            move,
+            destroy,
+            type,
+            get,
+        };
+
+        typedef R (*invoke_fn)(void *, Args &&...);
+        // the result is the type_info or the object, depending on the op
+        typedef const void *(*manage_fn)(op, void *, void *);
+
+        alignas(std::max_align_t) mutable unsigned char storage_[Capacity];
+        invoke_fn invoke_ = nullptr;
+        manage_fn manage_ = nullptr;
+
+        template <typename T>
+        static constexpr bool fits_()
+        {
+            return (sizeof(T) <= Capacity) && (alignof(T) <= alignof(std::max_align_t)) &&
+                   std::is_nothrow_move_constructible_v<T>;
+        }
+
+        template <typename T>
+        static R invoke_inline_(void *s, Args &&... args)
+        {
+            return (*std::launder(reinterpret_cast<T *>(s)))(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        static R invoke_heap_(void *s, Args &&... args)
+        {
+            return (**reinterpret_cast<T **>(s))(std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        static const void *manage_inline_(op o, void *s, void *dst)
+        {
+            T *obj = std::launder(reinterpret_cast<T *>(s));
+
+            switch (o) {
+                case op::move:
+                    new (dst) T(std::move(*obj));
+                    obj->~T();
+                break;
+                case op::destroy:
+                    obj->~T();
+                break;
+                case op::type:
+                    return &typeid(T);
+                case op::get:
+                    return obj;
+            }
+            return nullptr;
+        }
+
+        template <typename T>
+        static const void *manage_heap_(op o, void *s, void *dst)
+        {
+            T **obj = reinterpret_cast<T **>(s);
+
+            switch (o) {
+                case op::move:
+                    *reinterpret_cast<T **>(dst) = *obj;
+                break;
+                case op::destroy:
+                    delete *obj;
+                break;
+                case op::type:
+                    return &typeid(T);
+                case op::get:
+                    return *obj;
+            }
+            return nullptr;
+        }
+
+        void move_from_(inline_fn &other) noexcept
+        {
+            if (!other.manage_) {
+                return;
+            }
+
+            other.manage_(op::move, other.storage_, storage_);
+            invoke_ = other.invoke_;
+            manage_ = other.manage_;
+            other.invoke_ = nullptr;
+            other.manage_ = nullptr;
+        }
+
+        void reset_() noexcept
+        {
+            if (manage_) {
+                manage_(op::destroy, storage_, nullptr);
+                invoke_ = nullptr;
+                manage_ = nullptr;
+            }
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @brief - implements asynchronous I/O engine abstract class
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_IO_ENGINE_H__
+#define __AUTO_LIB_IO_ENGINE_H__
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include <functional>
+
+namespace auto_os::lib {
+
+/**
+ * @brief - completion callback
+ *
+ * @details - res is the result of the syscall: bytes read / written, the
+ *            accepted fd, or -errno. an expired timeout completes with -ETIME
+ */
+typedef std::function<void(int res)> io_completion_fn;
+
+/**
+ * @brief - list of supported I/O engines
+ */
+enum class io_engine_type {
+    // io_uring, batched submission and completion
+    io_uring,
+    // readiness through epoll, non-blocking syscalls
+    epoll,
+};
+
+/**
+ * @brief - implements I/O engine interface
+ *
+ * @details - operations are queued by submit_* and handed to the kernel in one
+ *            batch by flush. completions are delivered by reap once get_fd
+ *            turns readable, so the engine plugs into an event_manager
+ */
+class io_engine {
+    public:
+        explicit io_engine() = default;
+        virtual ~io_engine()
+        {
+            if (bufs_) {
+                free(bufs_);
+            }
+        }
+
+        io_engine(const io_engine &) = delete;
+        io_engine &operator=(const io_engine &) = delete;
+
+        /**
+         * @brief - returns the engine type
+         */
+        virtual io_engine_type get_type() const noexcept = 0;
+
+        /**
+         * @brief - returns the fd that turns readable when completions are pending
+         */
+        virtual int get_fd() const noexcept = 0;
+
+        /**
+         * @brief - allocate fixed receive buffers
+         *
+         * @param in n_bufs - number of buffers
+         * @param in buf_size - size of each buffer
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int register_buffers(uint32_t n_bufs, size_t buf_size) noexcept
+        {
+            if (bufs_ || (n_bufs == 0) || (buf_size == 0)) {
+                return -1;
+            }
+
+            bufs_ = static_cast<uint8_t *>(aligned_alloc(4096, ((n_bufs * buf_size) + 4095) & ~4095UL));
+            if (!bufs_) {
+                return -1;
+            }
+
+            n_bufs_ = n_bufs;
+            buf_size_ = buf_size;
+            return 0;
+        }
+
+        /**
+         * @brief - returns fixed buffer by index, nullptr if out of range
+         */
+        uint8_t *get_buffer(uint32_t buf_idx) const noexcept
+        {
+            if (buf_idx >= n_bufs_) {
+                return nullptr;
+            }
+            return bufs_ + buf_idx * buf_size_;
+        }
+
+        uint32_t get_n_buffers() const noexcept { return n_bufs_; }
+        size_t get_buffer_size() const noexcept { return buf_size_; }
+
+        /**
+         * @brief - read from fd into a caller buffer
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int submit_read(int fd, uint8_t *buf, size_t len, io_completion_fn fn) noexcept = 0;
+
+        /**
+         * @brief - read from fd into a fixed buffer
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int submit_read_fixed(int fd, uint32_t buf_idx, io_completion_fn fn) noexcept = 0;
+
+        /**
+         * @brief - write caller buffer to fd, the buffer must live until completion
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int submit_write(int fd, const uint8_t *buf, size_t len, io_completion_fn fn) noexcept = 0;
+
+        /**
+         * @brief - accept a connection on a listening socket, completes with the new fd
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int submit_accept(int fd, io_completion_fn fn) noexcept = 0;
+
+        /**
+         * @brief - complete with -ETIME after usec microseconds
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int submit_timeout(uint64_t usec, io_completion_fn fn) noexcept = 0;
+
+        /**
+         * @brief - cancel the operations pending on fd, they complete with -ECANCELED
+         *
+         * @details - call before closing fd, an operation left pending on a closed
+         *            fd would otherwise be tried on whatever reuses the number
+         *
+         * @return 0 on success -1 on failure
+         */
+        virtual int cancel_fd(int fd) noexcept = 0;
+
+        /**
+         * @brief - hand all queued operations to the kernel
+         *
+         * @return number of operations submitted -1 on failure
+         */
+        virtual int flush() noexcept = 0;
+
+        /**
+         * @brief - call completion callbacks of finished operations
+         *
+         * @return number of completions
+         */
+        virtual int reap() noexcept = 0;
+
+    protected:
+        uint8_t *bufs_ = nullptr;
+        uint32_t n_bufs_ = 0;
+        size_t buf_size_ = 0;
+};
+
+/**
+ * @brief - implements pending operation table, user data of an operation is its index
+ *
+ * @details - operations never move, the kernel may reference them until submission
+ */
+template <typename T>
+class io_engine_ops {
+    public:
+        uint32_t alloc()
+        {
+            uint32_t id;
+
+            if (free_.empty()) {
+                id = ops_.size();
+                ops_.emplace_back();
+            } else {
+                id = free_.back();
+                free_.pop_back();
+            }
+            return id;
+        }
+
+        void release(uint32_t id)
+        {
+            ops_[id] = T();
+            free_.push_back(id);
+        }
+
+        T &operator[](uint32_t id) { return ops_[id]; }
+        size_t in_flight() const { return ops_.size() - free_.size(); }
+
+    private:
+        std::deque<T> ops_;
+        std::vector<uint32_t> free_;
+};
+
+}
+
+#endif
+
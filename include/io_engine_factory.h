@@ -0,0 +1,72 @@
+/**
+ * @brief - implements I/O engine factory
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_IO_ENGINE_FACTORY_H__
+#define __AUTO_LIB_IO_ENGINE_FACTORY_H__
+
+#include <memory>
+#include <io_engine.h>
+#include <io_uring_engine.h>
+#include <epoll_io_engine.h>
+
+namespace auto_os::lib {
+
+/**
+ * @brief - implements I/O engine factory interface
+ */
+class io_engine_factory {
+    public:
+        ~io_engine_factory() { }
+        io_engine_factory(const io_engine_factory &) = delete;
+        io_engine_factory &operator=(const io_engine_factory &) = delete;
+        io_engine_factory(const io_engine_factory &&) = delete;
+        io_engine_factory &&operator=(const io_engine_factory &&) = delete;
+
+        /**
+         * @brief - get I/O engine factory instance
+         *
+         * @return factory instance
+         */
+        static io_engine_factory *instance()
+        {
+            static io_engine_factory fac;
+            return &fac;
+        }
+
+        /**
+         * @brief - create I/O engine
+         *
+         * @param in type - engine type
+         * @param in entries - submission queue size of io_uring
+         *
+         * @return io_uring engine if requested and the kernel supports every operation
+         *         it uses, epoll engine otherwise. nullptr on failure
+         */
+        std::shared_ptr<io_engine> create(io_engine_type type, uint32_t entries)
+        {
+            if (type == io_engine_type::io_uring) {
+                try {
+                    return std::make_shared<io_uring_engine>(entries);
+                } catch (const std::exception &e) {
+                    // kernel without io_uring or older than the operations the engine uses,
+                    // or io_uring disabled by seccomp / sysctl
+                }
+            }
+
+            try {
+                return std::make_shared<epoll_io_engine>();
+            } catch (const std::exception &e) {
+                return nullptr;
+            }
+        }
+
+    private:
+        explicit io_engine_factory() { }
+};
+
+}
+
+#endif
+
@@ -0,0 +1,467 @@
+/**
+ * @brief - implements io_uring I/O engine
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_IO_URING_ENGINE_H__
+#define __AUTO_LIB_IO_URING_ENGINE_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <io_engine.h>
+
+namespace auto_os::lib {
+
+/**
+ * @brief - implements io_uring pending operation
+ */
+struct io_uring_op {
+    io_completion_fn fn_;
+    // timeouts are read by the kernel at submission
+    struct __kernel_timespec ts_;
+};
+
+/**
+ * @brief - implements io_uring engine on top of the raw syscalls
+ */
+class io_uring_engine : public io_engine {
+    public:
+        /**
+         * @brief - create io_uring instance
+         *
+         * @param in entries - submission queue size
+         *
+         * This constructor will throw exception if io_uring is not supported, or the
+         * kernel lacks an opcode or the cancel by fd used by the engine (5.19 and later).
+         */
+        explicit io_uring_engine(uint32_t entries);
+        ~io_uring_engine();
+
+        io_engine_type get_type() const noexcept { return io_engine_type::io_uring; }
+        int get_fd() const noexcept { return fd_; }
+
+        /**
+         * @brief - allocate fixed receive buffers and register them with the kernel
+         *
+         * @details - registered buffers are pinned once, READ_FIXED skips the
+         *            per-operation page mapping
+         */
+        int register_buffers(uint32_t n_bufs, size_t buf_size) noexcept;
+
+        int submit_read(int fd, uint8_t *buf, size_t len, io_completion_fn fn) noexcept;
+        int submit_read_fixed(int fd, uint32_t buf_idx, io_completion_fn fn) noexcept;
+        int submit_write(int fd, const uint8_t *buf, size_t len, io_completion_fn fn) noexcept;
+        int submit_accept(int fd, io_completion_fn fn) noexcept;
+        int submit_timeout(uint64_t usec, io_completion_fn fn) noexcept;
+        int cancel_fd(int fd) noexcept;
+        int flush() noexcept;
+        int reap() noexcept;
+
+    private:
+        int fd_;
+        struct io_uring_params params_;
+
+        void *sq_ring_;
+        size_t sq_ring_size_;
+        void *cq_ring_;
+        size_t cq_ring_size_;
+        struct io_uring_sqe *sqes_;
+
+        unsigned *sq_head_;
+        unsigned *sq_tail_;
+        unsigned *sq_mask_;
+        unsigned *sq_array_;
+        unsigned *cq_head_;
+        unsigned *cq_tail_;
+        unsigned *cq_mask_;
+        struct io_uring_cqe *cqes_;
+
+        // sqes filled but not yet handed to the kernel
+        unsigned to_submit_ = 0;
+
+        // tail of the filled sqes, published to the kernel by flush
+        unsigned local_tail_ = 0;
+
+        io_engine_ops<io_uring_op> ops_;
+
+        struct io_uring_sqe *get_sqe_(io_completion_fn fn);
+        bool probe_();
+        void unmap_();
+};
+
+inline io_uring_engine::io_uring_engine(uint32_t entries)
+{
+    memset(&params_, 0, sizeof(params_));
+
+    fd_ = syscall(__NR_io_uring_setup, entries, &params_);
+    if (fd_ < 0) {
+        throw std::runtime_error("io_uring_setup failed");
+    }
+
+    sq_ring_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(struct io_uring_cqe);
+
+    // both rings share one mapping on kernels with IORING_FEAT_SINGLE_MMAP
+    if (params_.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        cq_ring_size_ = sq_ring_size_;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        close(fd_);
+        throw std::runtime_error("failed to map io_uring sq ring");
+    }
+
+    if (params_.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+            close(fd_);
+            throw std::runtime_error("failed to map io_uring cq ring");
+        }
+    }
+
+    sqes_ = static_cast<struct io_uring_sqe *>(mmap(nullptr, params_.sq_entries * sizeof(struct io_uring_sqe),
+                                                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                    fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+        if (cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        munmap(sq_ring_, sq_ring_size_);
+        close(fd_);
+        throw std::runtime_error("failed to map io_uring sqes");
+    }
+
+    uint8_t *sq = static_cast<uint8_t *>(sq_ring_);
+    uint8_t *cq = static_cast<uint8_t *>(cq_ring_);
+
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params_.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params_.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params_.cq_off.cqes);
+
+    local_tail_ = *sq_tail_;
+
+    if (!probe_()) {
+        unmap_();
+        close(fd_);
+        throw std::runtime_error("io_uring lacks the operations of the engine");
+    }
+}
+
+inline io_uring_engine::~io_uring_engine()
+{
+    unmap_();
+    close(fd_);
+}
+
+inline void io_uring_engine::unmap_()
+{
+    munmap(sqes_, params_.sq_entries * sizeof(struct io_uring_sqe));
+    if (cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+}
+
+inline bool io_uring_engine::probe_()
+{
+    static const uint8_t used_ops[] = {
+        IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_WRITE,
+        IORING_OP_ACCEPT, IORING_OP_TIMEOUT, IORING_OP_ASYNC_CANCEL,
+    };
+    const unsigned n_probe_ops = 256;
+    std::vector<uint8_t> buf(sizeof(struct io_uring_probe) + n_probe_ops * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(buf.data());
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    int ret;
+
+    // READ and WRITE come with the probe itself (5.6), older kernels fail here
+    ret = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, n_probe_ops);
+    if (ret < 0) {
+        return false;
+    }
+
+    for (auto op : used_ops) {
+        if ((op > probe->last_op) || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+
+    // the cancel flags have no probe, older kernels reject them with -EINVAL.
+    // nothing is pending on the ring fd, a kernel that knows them completes with 0
+    sqe = get_sqe_(nullptr);
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd_;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+
+    __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+    do {
+        ret = syscall(__NR_io_uring_enter, fd_, to_submit_, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0) {
+        return false;
+    }
+    to_submit_ -= ret;
+
+    head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    cqe = &cqes_[head & *cq_mask_];
+    ret = cqe->res;
+    ops_.release(cqe->user_data);
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+    return ret >= 0;
+}
+
+inline int io_uring_engine::register_buffers(uint32_t n_bufs, size_t buf_size) noexcept
+{
+    std::vector<struct iovec> iovs(n_bufs);
+    int ret;
+
+    ret = io_engine::register_buffers(n_bufs, buf_size);
+    if (ret < 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < n_bufs; i ++) {
+        iovs[i].iov_base = get_buffer(i);
+        iovs[i].iov_len = buf_size;
+    }
+
+    ret = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iovs.data(), n_bufs);
+    if (ret < 0) {
+        free(bufs_);
+        bufs_ = nullptr;
+        n_bufs_ = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+inline struct io_uring_sqe *io_uring_engine::get_sqe_(io_completion_fn fn)
+{
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned tail = local_tail_;
+    struct io_uring_sqe *sqe;
+    uint32_t id;
+
+    // the submission queue is full, hand the batch over first
+    if (tail - head >= params_.sq_entries) {
+        if (flush() < 0) {
+            return nullptr;
+        }
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (tail - head >= params_.sq_entries) {
+            return nullptr;
+        }
+    }
+
+    id = ops_.alloc();
+    ops_[id].fn_ = std::move(fn);
+
+    sqe = &sqes_[tail & *sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = id;
+
+    sq_array_[tail & *sq_mask_] = tail & *sq_mask_;
+    local_tail_ ++;
+    to_submit_ ++;
+
+    return sqe;
+}
+
+inline int io_uring_engine::submit_read(int fd, uint8_t *buf, size_t len, io_completion_fn fn) noexcept
+{
+    struct io_uring_sqe *sqe = get_sqe_(std::move(fn));
+
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    // streams have no offset, read at the current position
+    sqe->off = static_cast<uint64_t>(-1);
+
+    return 0;
+}
+
+inline int io_uring_engine::submit_read_fixed(int fd, uint32_t buf_idx, io_completion_fn fn) noexcept
+{
+    struct io_uring_sqe *sqe;
+
+    if (buf_idx >= n_bufs_) {
+        return -1;
+    }
+
+    sqe = get_sqe_(std::move(fn));
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(get_buffer(buf_idx));
+    sqe->len = buf_size_;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->buf_index = buf_idx;
+
+    return 0;
+}
+
+inline int io_uring_engine::submit_write(int fd, const uint8_t *buf, size_t len, io_completion_fn fn) noexcept
+{
+    struct io_uring_sqe *sqe = get_sqe_(std::move(fn));
+
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = static_cast<uint64_t>(-1);
+
+    return 0;
+}
+
+inline int io_uring_engine::submit_accept(int fd, io_completion_fn fn) noexcept
+{
+    struct io_uring_sqe *sqe = get_sqe_(std::move(fn));
+
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = static_cast<int>(SOCK_NONBLOCK) | SOCK_CLOEXEC;
+
+    return 0;
+}
+
+inline int io_uring_engine::submit_timeout(uint64_t usec, io_completion_fn fn) noexcept
+{
+    struct io_uring_sqe *sqe = get_sqe_(std::move(fn));
+
+    if (!sqe) {
+        return -1;
+    }
+
+    io_uring_op &op = ops_[sqe->user_data];
+
+    op.ts_.tv_sec = usec / 1000000;
+    op.ts_.tv_nsec = (usec % 1000000) * 1000;
+
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&op.ts_);
+    sqe->len = 1;
+
+    return 0;
+}
+
+inline int io_uring_engine::cancel_fd(int fd) noexcept
+{
+    // the cancel itself completes without a callback
+    struct io_uring_sqe *sqe = get_sqe_(nullptr);
+
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+
+    // the cancel must reach the kernel before the caller closes fd
+    return (flush() < 0) ? -1 : 0;
+}
+
+inline int io_uring_engine::flush() noexcept
+{
+    int ret;
+
+    if (to_submit_ == 0) {
+        return 0;
+    }
+
+    // sqes are complete, make them visible to the kernel
+    __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+
+    do {
+        ret = syscall(__NR_io_uring_enter, fd_, to_submit_, 0, 0, nullptr, 0);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0) {
+        return -1;
+    }
+
+    to_submit_ -= ret;
+    return ret;
+}
+
+inline int io_uring_engine::reap() noexcept
+{
+    unsigned head = *cq_head_;
+    int count = 0;
+
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+        uint32_t id = cqe->user_data;
+        int res = cqe->res;
+
+        // the slot is released before the callback so it can submit again
+        io_completion_fn fn = std::move(ops_[id].fn_);
+        ops_.release(id);
+
+        head ++;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+        if (fn) {
+            fn(res);
+        }
+        count ++;
+    }
+
+    return count;
+}
+
+}
+
+#endif
+
@@ -4,25 +4,82 @@
  * @author - Devendra Naga (devendra.aaru@outlook.com)
  * @copyright - 2021-present All rights reserved
  */
+#ifndef __AUTO_LIB_MANAGED_SERVER_H__
+#define __AUTO_LIB_MANAGED_SERVER_H__
+
 #include <iostream>
 #include <functional>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <event_manager.h>
+#include <event_manager_group.h>
+#include <rx_buffer_pool.h>
 #include <helpers.h>
 
 namespace auto_os::lib {
 
+// the servers are header only, the versioned namespace keeps them apart from the
+// tcp_managed_server symbols still exported by the prebuilt libauto_lib.so
+inline namespace v2 {
+
 typedef std::function<void(int)> on_accept;
 
+// size of the receive buffer of a client
+static constexpr size_t tcp_managed_server_rx_buf_size = 4096;
+
+// output queued per client before the high watermark callback is called
+static constexpr size_t tcp_managed_server_high_wm = 256 * 1024;
+
+// output queued per client below which the low watermark callback is called
+static constexpr size_t tcp_managed_server_low_wm = 64 * 1024;
+
+// output queued per client beyond which the client is disconnected
+static constexpr size_t tcp_managed_server_max_queued = 4 * 1024 * 1024;
+
+// queued buffers written with one system call
+static constexpr int tcp_managed_server_flush_iov = 64;
+
+// connections accepted per wakeup, the rest waits for the next one so clients are served meanwhile
+static constexpr int tcp_managed_server_accept_batch = 64;
+
+class tcp_managed_server;
+
+/**
+ * @brief - refers to a connected client, stays invalid once the client is gone
+ */
+struct tcp_client_handle {
+    int fd_ = -1;
+    uint32_t gen_ = 0;
+
+    /**
+     * @brief - returns false if the handle refers to no client
+     */
+    bool valid() const { return fd_ >= 0; }
+};
+
 /**
  * @brief - tcp client instance - created if a client is connected
+ *
+ * @details - an instance lives at a fixed address in the table of its server
+ *            while the client is connected, and is reused for the next client
+ *            accepted on the same fd
  */
 class tcp_client_instance {
     public:
         explicit tcp_client_instance() { }
         ~tcp_client_instance() { }
 
+        tcp_client_instance(const tcp_client_instance &) = delete;
+        tcp_client_instance &operator=(const tcp_client_instance &) = delete;
+
         void set_socket(int fd) { fd_ = fd; }
         void set_ipaddr(const std::string ipaddr) { ipaddr_ = ipaddr; }
         void set_port(int port) { port_ = port; }
@@ -30,20 +87,61 @@ class tcp_client_instance {
         int get_socket() { return fd_; }
 
         /**
-         * @brief - send message to the server
+         * @brief - returns handle to look the client up later with tcp_managed_server::find_client
+         */
+        tcp_client_handle get_handle() const { return tcp_client_handle{fd_, gen_}; }
+
+        /**
+         * @brief - returns number of bytes queued and not taken by the socket yet
+         */
+        size_t get_queued() const { return out_bytes_; }
+
+        /**
+         * @brief - send message to the client
          *
          * @param in data - data to send
          * @param in data_len - length of data
          *
-         * @return length of message that is sent -1 otherwise
+         * @details - never blocks, what the socket does not take right away is
+         *            queued and written once the socket turns writable. a client
+         *            whose queue would grow past the limit is disconnected
+         *
+         * @return length of message that is sent or queued, -1 otherwise
+         *         with errno ENOBUFS if the client is disconnected for being slow
          */
         int send_msg(uint8_t *data, size_t data_len);
 
     private:
-        int fd_;
+        friend class tcp_managed_server;
+
+        int fd_ = -1;
+        // bumped each time the slot is released, stale handles stop matching
+        uint32_t gen_ = 0;
         std::string ipaddr_;
-        int port_;
-        auto_os::lib::event_manager *evt_mgr_;
+        int port_ = 0;
+        auto_os::lib::event_manager *evt_mgr_ = nullptr;
+
+        // receive buffer, used when no fixed buffer of the I/O engine is free
+        std::vector<uint8_t> rx_buf_;
+        // fixed buffer of the I/O engine, -1 if none
+        int rx_buf_idx_ = -1;
+        // pool buffer of the read pending on the I/O engine
+        rx_buffer pending_;
+        // set once the client is being removed and its pending read is completing
+        bool closing_ = false;
+
+        // server owning the client, output is queued through it
+        tcp_managed_server *server_ = nullptr;
+        // output not taken by the socket yet, in send order
+        std::deque<std::vector<uint8_t>> out_q_;
+        // bytes of the front buffer already sent
+        size_t out_off_ = 0;
+        // bytes queued, including a write in flight on the I/O engine
+        size_t out_bytes_ = 0;
+        // set from crossing the high watermark until falling to the low watermark
+        bool above_high_ = false;
+        // buffer being written by the I/O engine, nullptr if none
+        const std::vector<uint8_t> *write_buf_ = nullptr;
 };
 
 /**
@@ -51,6 +149,17 @@ class tcp_client_instance {
  */
 typedef std::function<void(tcp_client_instance &inst, uint8_t *, size_t)> on_receive;
 
+/**
+ * @brief - on_backpressure callback - called when the output queue of a client crosses a watermark
+ */
+typedef std::function<void(tcp_client_instance &inst)> on_backpressure;
+
+/**
+ * @brief - on_receive_buffer callback - called with data received into a pool buffer,
+ *          copy or move buf to keep it past the call
+ */
+typedef std::function<void(tcp_client_instance &inst, rx_buffer &buf)> on_receive_buffer;
+
 /**
  * @brief - impplements tcp managed server
  */
@@ -66,6 +175,27 @@ class tcp_managed_server {
          */
         void set_evt_mgr(auto_os::lib::event_manager *evt_mgr) { evt_mgr_ = evt_mgr; }
 
+        /**
+         * @brief - accept and receive through the I/O engine of the event manager
+         *
+         * @param in enable - true to submit accepts and reads on the engine, the
+         *                    event manager must have an engine enabled
+         *
+         * @details - call before create_server. the server registers one fixed
+         *            buffer per connection if the engine has none registered yet
+         */
+        void use_io_engine(bool enable) { use_io_ = enable; }
+
+        /**
+         * @brief - allow more servers to bind to the same address and port
+         *
+         * @param in enable - set SO_REUSEPORT, the kernel balances new
+         *                    connections across the listeners
+         *
+         * @details - call before create_server
+         */
+        void set_reuse_port(bool enable) { reuse_port_ = enable; }
+
         /**
          * @brief - create managed tcp server
          *
@@ -94,17 +224,879 @@ class tcp_managed_server {
             accept_cb_ = accept_cb;
         }
 
+        /**
+         * @brief - set limits of the output queue of each client
+         *
+         * @param in high_wm - queued bytes at which the high callback is called
+         * @param in low_wm - queued bytes at which the low callback is called after the high one
+         * @param in max_queued - queued bytes beyond which the client is disconnected
+         */
+        void set_output_limits(size_t high_wm, size_t low_wm, size_t max_queued)
+        {
+            high_wm_ = high_wm;
+            low_wm_ = low_wm;
+            max_queued_ = max_queued;
+        }
+
+        /**
+         * @brief - register backpressure callbacks
+         *
+         * @param in high_cb - called once the output queue of a client reaches the high watermark,
+         *                     such as to stop producing for it
+         * @param in low_cb - called once that queue drained to the low watermark
+         */
+        void register_backpressure_callbacks(on_backpressure high_cb, on_backpressure low_cb)
+        {
+            high_cb_ = high_cb;
+            low_cb_ = low_cb;
+        }
+
+        /**
+         * @brief - receive into buffers of a pool shared with other servers
+         *
+         * @param in pool - pool, must outlive the server and the buffers kept by the callbacks
+         *
+         * @details - call before create_server. a client holds no buffer while idle, except
+         *            for the one of its pending read on the I/O engine, which then uses no
+         *            fixed buffers
+         */
+        void set_rx_buffer_pool(std::shared_ptr<rx_buffer_pool> pool) { pool_ = pool; }
+
+        /**
+         * @brief - receive data as pool buffers that may be kept past the callback
+         *
+         * @param in receive_cb - called with the data of any client, replaces the on_receive callback
+         *
+         * @details - call before create_server. a pool is created if none is set, its
+         *            buffers must be released before the server is destroyed
+         */
+        void register_buffer_callback(on_receive_buffer receive_cb)
+        {
+            receive_buf_cb_ = receive_cb;
+            if (!pool_) {
+                pool_ = std::make_shared<rx_buffer_pool>(tcp_managed_server_rx_buf_size);
+            }
+        }
+
+        /**
+         * @brief - find a connected client
+         *
+         * @param in handle - handle of the client
+         *
+         * @return client, nullptr if it is gone
+         */
+        tcp_client_instance *find_client(const tcp_client_handle &handle)
+        {
+            tcp_client_instance *inst = find_client_(handle.fd_);
+
+            return (inst && (inst->gen_ == handle.gen_)) ? inst : nullptr;
+        }
+
+        /**
+         * @brief - returns number of connected clients
+         */
+        size_t get_n_clients() const { return n_clients_; }
+
+        /**
+         * @brief - sample the accept queue length and the time connections waited in it
+         *
+         * @param in enable - true to sample, costs a getsockopt per wakeup and per connection
+         */
+        void enable_accept_stats(bool enable) { accept_stats_on_ = enable; }
+
+        /**
+         * @brief - returns accept statistics, call from the loop thread or once it stopped
+         */
+        tcp_accept_stats get_accept_stats() const { return accept_stats_; }
+
     private:
+        friend class tcp_client_instance;
+
         on_receive receive_cb_;
         on_accept accept_cb_;
+        on_receive_buffer receive_buf_cb_;
+        std::shared_ptr<rx_buffer_pool> pool_;
+        on_backpressure high_cb_;
+        on_backpressure low_cb_;
+        size_t high_wm_ = tcp_managed_server_high_wm;
+        size_t low_wm_ = tcp_managed_server_low_wm;
+        size_t max_queued_ = tcp_managed_server_max_queued;
+        bool accept_stats_on_ = false;
+        tcp_accept_stats accept_stats_;
         void accept_connections(int fd);
         void receive_data(int fd);
         void remove_client(int fd);
+        int send_(tcp_client_instance &inst, const uint8_t *data, size_t data_len);
+        void on_writable_(int fd);
+        void consume_(tcp_client_instance &inst, size_t len);
+        void drained_(tcp_client_instance &inst);
+        void flush_io_(tcp_client_instance &inst);
+        void on_write_(int fd, const std::shared_ptr<std::vector<uint8_t>> &buf, int res);
+        void add_client_(int fd, struct sockaddr_in &addr);
+        void release_client_(tcp_client_instance &inst);
+        tcp_client_instance *find_client_(int fd)
+        {
+            if ((fd < 0) || (static_cast<size_t>(fd) >= clients_.size()) ||
+                !clients_[fd] || (clients_[fd]->fd_ != fd)) {
+                return nullptr;
+            }
+
+            return clients_[fd].get();
+        }
+        void submit_accept_();
+        void submit_read_(int fd);
+        void on_read_(int fd, int res);
+        void deliver_(tcp_client_instance &inst, rx_buffer &buf);
         auto_os::lib::event_manager *evt_mgr_;
         std::string ipaddr_;
         int fd_;
-        std::vector<tcp_client_instance> clients_;
+        bool use_io_ = false;
+        bool reuse_port_ = false;
+        io_engine *io_ = nullptr;
+        // completions of the I/O engine may arrive after the server is gone
+        std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+        // fixed buffers of the I/O engine not handed to a client
+        std::vector<uint32_t> free_bufs_;
+        // indexed by fd, slots are kept once allocated and reused by later clients
+        std::vector<std::unique_ptr<tcp_client_instance>> clients_;
+        size_t n_clients_ = 0;
 };
 
+/**
+ * @brief - implements tcp managed server sharded over a group of event loops
+ *
+ * @details - one listener per loop is bound to the same address with
+ *            SO_REUSEPORT, a connection lives on the loop that accepted it
+ *            and its callbacks run on that loop's thread
+ */
+class sharded_tcp_managed_server {
+    public:
+        explicit sharded_tcp_managed_server(auto_os::lib::event_manager_group *group) :
+                                            group_(group) { }
+        ~sharded_tcp_managed_server() { delete_server(); }
+
+        /**
+         * @brief - accept and receive through the I/O engine of each loop
+         *
+         * @param in enable - every loop of the group must have an engine enabled
+         */
+        void use_io_engine(bool enable) { use_io_ = enable; }
+
+        /**
+         * @brief - create one managed tcp server per loop
+         *
+         * @param in ipaddr - ipaddress of the server
+         * @param in port - port number of the server
+         * @param in n_conn - number of connections per loop
+         *
+         * @return 0 on success -1 on failure
+         */
+        int create_server(const std::string ipaddr, int port, int n_conn);
+
+        /**
+         * @brief - delete the servers, call once the group is stopped
+         */
+        void delete_server() { servers_.clear(); }
+
+        /**
+         * @brief - register callbacks, called from the thread of the owning loop
+         *
+         * @param in receive_cb - receive callback - called when there is a data from any client
+         * @param in accept_cb - accept callback - called when a client is connected
+         */
+        void register_callbacks(on_receive receive_cb, on_accept accept_cb = nullptr)
+        {
+            receive_cb_ = receive_cb;
+            accept_cb_ = accept_cb;
+        }
+
+        /**
+         * @brief - set limits of the output queue of each client, see tcp_managed_server
+         */
+        void set_output_limits(size_t high_wm, size_t low_wm, size_t max_queued)
+        {
+            high_wm_ = high_wm;
+            low_wm_ = low_wm;
+            max_queued_ = max_queued;
+        }
+
+        /**
+         * @brief - register backpressure callbacks, called from the thread of the owning loop
+         */
+        void register_backpressure_callbacks(on_backpressure high_cb, on_backpressure low_cb)
+        {
+            high_cb_ = high_cb;
+            low_cb_ = low_cb;
+        }
+
+        /**
+         * @brief - receive into a pool shared by all the loops, see tcp_managed_server
+         */
+        void set_rx_buffer_pool(std::shared_ptr<rx_buffer_pool> pool) { pool_ = pool; }
+
+        /**
+         * @brief - receive data as pool buffers, each loop creates its own pool if none is set
+         */
+        void register_buffer_callback(on_receive_buffer receive_cb) { receive_buf_cb_ = receive_cb; }
+
+        /**
+         * @brief - sample the accept queue of each listener, see tcp_managed_server
+         */
+        void enable_accept_stats(bool enable) { accept_stats_on_ = enable; }
+
+        /**
+         * @brief - returns accept statistics of all the loops, call once the group is stopped
+         */
+        tcp_accept_stats get_accept_stats() const
+        {
+            tcp_accept_stats stats;
+
+            for (auto &it : servers_) {
+                stats.merge(it->get_accept_stats());
+            }
+
+            return stats;
+        }
+
+    private:
+        auto_os::lib::event_manager_group *group_;
+        std::vector<std::unique_ptr<tcp_managed_server>> servers_;
+        on_receive receive_cb_;
+        on_accept accept_cb_;
+        on_receive_buffer receive_buf_cb_;
+        std::shared_ptr<rx_buffer_pool> pool_;
+        on_backpressure high_cb_;
+        on_backpressure low_cb_;
+        size_t high_wm_ = tcp_managed_server_high_wm;
+        size_t low_wm_ = tcp_managed_server_low_wm;
+        size_t max_queued_ = tcp_managed_server_max_queued;
+        bool accept_stats_on_ = false;
+        bool use_io_ = false;
+};
+
+inline int tcp_client_instance::send_msg(uint8_t *data, size_t data_len)
+{
+    if (server_) {
+        return server_->send_(*this, data, data_len);
+    }
+
+    return send(fd_, data, data_len, MSG_NOSIGNAL);
+}
+
+inline tcp_managed_server::tcp_managed_server()
+{
+    evt_mgr_ = nullptr;
+    fd_ = -1;
 }
 
+inline tcp_managed_server::~tcp_managed_server()
+{
+    delete_server();
+}
+
+inline int tcp_managed_server::create_server(const std::string ipaddr, int port, int n_conn)
+{
+    struct sockaddr_in addr = {};
+    int reuse = 1;
+    int ret;
+
+    if (!evt_mgr_) {
+        evt_mgr_ = auto_os::lib::event_manager::instance();
+    }
+
+    // the loop drains the accept queue until it is empty, and an epoll I/O engine
+    // must not block in accept when the client is gone before it is accepted
+    fd_ = socket(AF_INET, static_cast<int>(SOCK_STREAM) | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd_ < 0) {
+        return -1;
+    }
+
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuse_port_) {
+        ret = setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+        if (ret < 0) {
+            goto err;
+        }
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(ipaddr.c_str());
+    addr.sin_port = htons(port);
+
+    ret = bind(fd_, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret < 0) {
+        goto err;
+    }
+
+    ret = listen(fd_, n_conn);
+    if (ret < 0) {
+        goto err;
+    }
+
+    ipaddr_ = ipaddr;
+
+    if (use_io_) {
+        io_ = evt_mgr_->get_io_engine();
+        if (!io_) {
+            goto err;
+        }
+        // fixed buffers registered by someone else are not ours to hand out
+        if (!pool_ && (io_->get_n_buffers() == 0) &&
+            (io_->register_buffers(n_conn, tcp_managed_server_rx_buf_size) == 0)) {
+            for (uint32_t i = 0; i < io_->get_n_buffers(); i ++) {
+                free_bufs_.push_back(i);
+            }
+        }
+        submit_accept_();
+        return 0;
+    }
+
+    if (!evt_mgr_->create_socket_event(fd_,
+                        std::bind(&tcp_managed_server::accept_connections,
+                                  this, std::placeholders::_1)).valid()) {
+        goto err;
+    }
+
+    return 0;
+
+err:
+    AUTO_OS_SAFE_CLOSE_FD(fd_);
+    return -1;
+}
+
+inline void tcp_managed_server::delete_server()
+{
+    for (auto &it : clients_) {
+        int fd = it ? it->fd_ : -1;
+
+        if (fd < 0) {
+            continue;
+        }
+
+        // the pending read and write complete with -ECANCELED
+        if (io_) {
+            io_->cancel_fd(fd);
+        } else {
+            evt_mgr_->delete_socket_event(fd);
+        }
+        close(fd);
+        release_client_(*it);
+    }
+
+    if (fd_ >= 0) {
+        if (io_) {
+            io_->cancel_fd(fd_);
+        } else {
+            evt_mgr_->delete_socket_event(fd_);
+        }
+        AUTO_OS_SAFE_CLOSE_FD(fd_);
+    }
+}
+
+inline void tcp_managed_server::release_client_(tcp_client_instance &inst)
+{
+    if (inst.rx_buf_idx_ >= 0) {
+        free_bufs_.push_back(inst.rx_buf_idx_);
+    }
+
+    // rx_buf_ is kept for the next client of the slot
+    inst.fd_ = -1;
+    inst.gen_ ++;
+    inst.rx_buf_idx_ = -1;
+    inst.pending_.release();
+    inst.closing_ = false;
+    inst.out_q_.clear();
+    inst.out_off_ = 0;
+    inst.out_bytes_ = 0;
+    inst.above_high_ = false;
+    inst.write_buf_ = nullptr;
+    n_clients_ --;
+}
+
+inline void tcp_managed_server::add_client_(int fd, struct sockaddr_in &addr)
+{
+    char ip[INET_ADDRSTRLEN];
+
+    if (static_cast<size_t>(fd) >= clients_.size()) {
+        clients_.resize(fd + 1);
+    }
+    if (!clients_[fd]) {
+        clients_[fd] = std::make_unique<tcp_client_instance>();
+    }
+
+    tcp_client_instance &inst = *clients_[fd];
+
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+
+    inst.set_socket(fd);
+    inst.set_ipaddr(ip);
+    inst.set_port(ntohs(addr.sin_port));
+    inst.set_event_mgr(evt_mgr_);
+    inst.server_ = this;
+
+    accept_stats_.accepted_ ++;
+    if (accept_stats_on_) {
+        int wait_ms = tcp_accept_wait_msec(fd);
+
+        if (wait_ms >= 0) {
+            accept_stats_.accept_wait_ms_.record(wait_ms);
+        }
+    }
+
+    if (pool_) {
+        // buffers are taken from the pool per read
+    } else if (io_ && !free_bufs_.empty()) {
+        inst.rx_buf_idx_ = free_bufs_.back();
+        free_bufs_.pop_back();
+    } else if (inst.rx_buf_.empty()) {
+        inst.rx_buf_.resize(tcp_managed_server_rx_buf_size);
+    }
+
+    n_clients_ ++;
+
+    if (accept_cb_) {
+        accept_cb_(fd);
+    }
+}
+
+inline void tcp_managed_server::accept_connections(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+    uint32_t q_len;
+    uint32_t q_max;
+    int n_accepted = 0;
+    int cl_fd;
+
+    if (accept_stats_on_ && (tcp_accept_queue(fd, q_len, q_max) == 0)) {
+        accept_stats_.queue_len_.record(q_len);
+        if (q_len > q_max) {
+            accept_stats_.queue_overflows_ ++;
+        }
+    }
+
+    // a reconnect storm is drained in batches rather than a wakeup per client
+    while (n_accepted < tcp_managed_server_accept_batch) {
+        addr_len = sizeof(addr);
+        cl_fd = accept4(fd, (struct sockaddr *)&addr, &addr_len, static_cast<int>(SOCK_NONBLOCK) | SOCK_CLOEXEC);
+        if (cl_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                accept_stats_.accept_errors_ ++;
+            }
+            break;
+        }
+
+        n_accepted ++;
+        add_client_(cl_fd, addr);
+
+        if (!evt_mgr_->create_socket_event(cl_fd,
+                            std::bind(&tcp_managed_server::receive_data,
+                                      this, std::placeholders::_1)).valid()) {
+            remove_client(cl_fd);
+            continue;
+        }
+
+        evt_mgr_->set_write_event(cl_fd, std::bind(&tcp_managed_server::on_writable_,
+                                                   this, std::placeholders::_1));
+    }
+
+    accept_stats_.batch_size_.record(n_accepted);
+}
+
+inline void tcp_managed_server::receive_data(int fd)
+{
+    tcp_client_instance *inst = find_client_(fd);
+    int ret;
+
+    if (!inst) {
+        return;
+    }
+
+    // disconnected for being slow
+    if (inst->closing_) {
+        remove_client(fd);
+        return;
+    }
+
+    if (pool_) {
+        rx_buffer buf = pool_->get();
+
+        ret = buf.valid() ? recv(fd, buf.data(), buf.capacity(), 0) : -1;
+        if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+            return;
+        }
+        if (ret <= 0) {
+            remove_client(fd);
+            return;
+        }
+
+        buf.set_size(ret);
+        deliver_(*inst, buf);
+        return;
+    }
+
+    ret = recv(fd, inst->rx_buf_.data(), inst->rx_buf_.size(), 0);
+    if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+        return;
+    }
+    if (ret <= 0) {
+        remove_client(fd);
+        return;
+    }
+
+    if (receive_cb_) {
+        receive_cb_(*inst, inst->rx_buf_.data(), ret);
+    }
+}
+
+inline void tcp_managed_server::deliver_(tcp_client_instance &inst, rx_buffer &buf)
+{
+    if (receive_buf_cb_) {
+        receive_buf_cb_(inst, buf);
+    } else if (receive_cb_) {
+        receive_cb_(inst, buf.data(), buf.size());
+    }
+}
+
+inline void tcp_managed_server::remove_client(int fd)
+{
+    tcp_client_instance *inst = find_client_(fd);
+
+    if (!inst) {
+        return;
+    }
+
+    if (io_) {
+        // the pending read completes with 0, on_read_ releases the client
+        if (!inst->closing_) {
+            inst->closing_ = true;
+            shutdown(fd, SHUT_RDWR);
+        }
+        return;
+    }
+
+    evt_mgr_->delete_socket_event(fd);
+    close(fd);
+    release_client_(*inst);
+}
+
+inline int tcp_managed_server::send_(tcp_client_instance &inst, const uint8_t *data, size_t data_len)
+{
+    ssize_t ret = 0;
+
+    if (inst.closing_) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    // nothing queued, the socket takes what it can right away
+    if (inst.out_bytes_ == 0) {
+        ret = send(inst.fd_, data, data_len, static_cast<int>(MSG_NOSIGNAL) | MSG_DONTWAIT);
+        if (ret < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                return -1;
+            }
+            ret = 0;
+        }
+        if ((size_t)ret == data_len) {
+            return ret;
+        }
+    }
+
+    // a consumer this slow would only grow the queue, the read side removes it
+    if (inst.out_bytes_ + (data_len - ret) > max_queued_) {
+        inst.closing_ = true;
+        shutdown(inst.fd_, SHUT_RDWR);
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    inst.out_q_.emplace_back(data + ret, data + data_len);
+    inst.out_bytes_ += data_len - ret;
+
+    if (io_) {
+        flush_io_(inst);
+    } else {
+        evt_mgr_->arm_write_event(inst.fd_, true);
+    }
+
+    if (!inst.above_high_ && (inst.out_bytes_ >= high_wm_)) {
+        inst.above_high_ = true;
+        if (high_cb_) {
+            high_cb_(inst);
+        }
+    }
+
+    return data_len;
+}
+
+inline void tcp_managed_server::consume_(tcp_client_instance &inst, size_t len)
+{
+    inst.out_bytes_ -= len;
+
+    while (len > 0) {
+        size_t left = inst.out_q_.front().size() - inst.out_off_;
+
+        if (len < left) {
+            inst.out_off_ += len;
+            break;
+        }
+
+        len -= left;
+        inst.out_q_.pop_front();
+        inst.out_off_ = 0;
+    }
+}
+
+inline void tcp_managed_server::drained_(tcp_client_instance &inst)
+{
+    if (inst.above_high_ && (inst.out_bytes_ <= low_wm_)) {
+        inst.above_high_ = false;
+        if (low_cb_) {
+            low_cb_(inst);
+        }
+    }
+}
+
+inline void tcp_managed_server::on_writable_(int fd)
+{
+    tcp_client_instance *inst = find_client_(fd);
+    struct iovec iov[tcp_managed_server_flush_iov];
+    int n_iov = 0;
+    int ret;
+
+    if (!inst) {
+        return;
+    }
+
+    for (auto &it : inst->out_q_) {
+        size_t off = (n_iov == 0) ? inst->out_off_ : 0;
+
+        if (n_iov == tcp_managed_server_flush_iov) {
+            break;
+        }
+
+        iov[n_iov].iov_base = it.data() + off;
+        iov[n_iov].iov_len = it.size() - off;
+        n_iov ++;
+    }
+
+    ret = socket_sendv(fd, iov, n_iov);
+    if (ret < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            remove_client(fd);
+        }
+        return;
+    }
+
+    consume_(*inst, ret);
+    if (inst->out_bytes_ == 0) {
+        evt_mgr_->arm_write_event(fd, false);
+    }
+
+    drained_(*inst);
+}
+
+inline void tcp_managed_server::flush_io_(tcp_client_instance &inst)
+{
+    std::weak_ptr<bool> alive = alive_;
+    std::shared_ptr<std::vector<uint8_t>> buf;
+    int fd = inst.fd_;
+
+    // one write in flight keeps the stream in order
+    if (inst.write_buf_ || inst.out_q_.empty() || inst.closing_) {
+        return;
+    }
+
+    // the buffer leaves the queue, so it outlives the client if that goes first
+    buf = std::make_shared<std::vector<uint8_t>>(std::move(inst.out_q_.front()));
+    inst.out_q_.pop_front();
+    if (inst.out_off_ > 0) {
+        buf->erase(buf->begin(), buf->begin() + inst.out_off_);
+        inst.out_off_ = 0;
+    }
+
+    inst.write_buf_ = buf.get();
+    io_->submit_write(fd, buf->data(), buf->size(), [this, alive, buf, fd](int res) {
+        if (!alive.expired()) {
+            on_write_(fd, buf, res);
+        }
+    });
+}
+
+inline void tcp_managed_server::on_write_(int fd, const std::shared_ptr<std::vector<uint8_t>> &buf, int res)
+{
+    tcp_client_instance *inst = find_client_(fd);
+
+    // the client is gone, or the fd belongs to a new one
+    if (!inst || (inst->write_buf_ != buf.get())) {
+        return;
+    }
+
+    inst->write_buf_ = nullptr;
+    if (inst->closing_) {
+        return;
+    }
+
+    if ((res == -EAGAIN) || (res == -EINTR)) {
+        res = 0;
+    } else if (res <= 0) {
+        remove_client(fd);
+        return;
+    }
+
+    inst->out_bytes_ -= res;
+    if ((size_t)res < buf->size()) {
+        buf->erase(buf->begin(), buf->begin() + res);
+        inst->out_q_.push_front(std::move(*buf));
+    }
+
+    drained_(*inst);
+
+    // the callback may have removed the client
+    inst = find_client_(fd);
+    if (inst) {
+        flush_io_(*inst);
+    }
+}
+
+inline void tcp_managed_server::submit_accept_()
+{
+    std::weak_ptr<bool> alive = alive_;
+
+    io_->submit_accept(fd_, [this, alive](int res) {
+        struct sockaddr_in addr = {};
+        socklen_t addr_len = sizeof(addr);
+
+        // the listener was shut down
+        if (alive.expired() || (fd_ < 0)) {
+            if (res >= 0) {
+                close(res);
+            }
+            return;
+        }
+
+        if (res >= 0) {
+            getpeername(res, (struct sockaddr *)&addr, &addr_len);
+            add_client_(res, addr);
+            accept_stats_.batch_size_.record(1);
+            submit_read_(res);
+        } else if (res != -EINTR) {
+            accept_stats_.accept_errors_ ++;
+        }
+
+        submit_accept_();
+    });
+}
+
+inline void tcp_managed_server::submit_read_(int fd)
+{
+    tcp_client_instance *inst = find_client_(fd);
+
+    if (!inst) {
+        return;
+    }
+
+    std::weak_ptr<bool> alive = alive_;
+    // a cancelled read belongs to a released client, fd may be a new one by now
+    auto cb = [this, alive, fd](int res) {
+        if (!alive.expired() && (res != -ECANCELED)) {
+            on_read_(fd, res);
+        }
+    };
+
+    if (pool_) {
+        inst->pending_ = pool_->get();
+        if (!inst->pending_.valid()) {
+            // no read is pending to complete the removal, a write may be
+            io_->cancel_fd(fd);
+            close(fd);
+            release_client_(*inst);
+            return;
+        }
+        io_->submit_read(fd, inst->pending_.data(), inst->pending_.capacity(), cb);
+    } else if (inst->rx_buf_idx_ >= 0) {
+        io_->submit_read_fixed(fd, inst->rx_buf_idx_, cb);
+    } else {
+        io_->submit_read(fd, inst->rx_buf_.data(), inst->rx_buf_.size(), cb);
+    }
+}
+
+inline void tcp_managed_server::on_read_(int fd, int res)
+{
+    tcp_client_instance *inst = find_client_(fd);
+    uint8_t *buf;
+
+    if (!inst) {
+        return;
+    }
+
+    if ((res <= 0) || inst->closing_) {
+        // a write may still be queued on fd
+        io_->cancel_fd(fd);
+        close(fd);
+        release_client_(*inst);
+        return;
+    }
+
+    if (pool_) {
+        rx_buffer pooled = std::move(inst->pending_);
+
+        pooled.set_size(res);
+        deliver_(*inst, pooled);
+    } else {
+        buf = (inst->rx_buf_idx_ >= 0) ? io_->get_buffer(inst->rx_buf_idx_) : inst->rx_buf_.data();
+
+        if (receive_cb_) {
+            receive_cb_(*inst, buf, res);
+        }
+    }
+
+    // the callback may have removed the client
+    inst = find_client_(fd);
+    if (inst && !inst->closing_) {
+        submit_read_(fd);
+    } else if (inst) {
+        on_read_(fd, 0);
+    }
+}
+
+inline int sharded_tcp_managed_server::create_server(const std::string ipaddr, int port, int n_conn)
+{
+    for (uint32_t i = 0; i < group_->size(); i ++) {
+        auto serv = std::make_unique<tcp_managed_server>();
+
+        serv->set_evt_mgr(group_->get(i));
+        serv->set_reuse_port(true);
+        serv->use_io_engine(use_io_);
+        serv->register_callbacks(receive_cb_, accept_cb_);
+        serv->set_output_limits(high_wm_, low_wm_, max_queued_);
+        serv->register_backpressure_callbacks(high_cb_, low_cb_);
+        serv->enable_accept_stats(accept_stats_on_);
+        if (pool_) {
+            serv->set_rx_buffer_pool(pool_);
+        }
+        if (receive_buf_cb_) {
+            serv->register_buffer_callback(receive_buf_cb_);
+        }
+
+        if (serv->create_server(ipaddr, port, n_conn) < 0) {
+            servers_.clear();
+            return -1;
+        }
+
+        servers_.push_back(std::move(serv));
+    }
+
+    return 0;
+}
+
+}
+
+}
+
+#endif
+
@@ -0,0 +1,120 @@
+/**
+ * @brief - implements bounded lock-free multi producer single consumer queue
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_MPSC_QUEUE_H__
+#define __AUTO_LIB_MPSC_QUEUE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace auto_os::lib {
+
+// size of a cache line, keeps producer and consumer indices apart
+static constexpr size_t mpsc_queue_cache_line = 64;
+
+/**
+ * @brief - implements bounded MPSC queue
+ *
+ * @details - every cell carries a sequence number, a producer claims a cell
+ *            with one CAS on the tail and publishes it by bumping the sequence.
+ *            only one thread may call pop
+ */
+template <typename T>
+class mpsc_queue {
+    public:
+        /**
+         * @brief - create queue
+         *
+         * @param in capacity - number of cells, rounded up to a power of two
+         */
+        explicit mpsc_queue(size_t capacity)
+        {
+            size_t size = 2;
+
+            while (size < capacity) {
+                size <<= 1;
+            }
+
+            mask_ = size - 1;
+            cells_ = std::make_unique<cell[]>(size);
+            for (size_t i = 0; i < size; i ++) {
+                cells_[i].seq_.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        mpsc_queue(const mpsc_queue &) = delete;
+        mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+        /**
+         * @brief - push an element, safe from any thread
+         *
+         * @return true on success false if the queue is full
+         */
+        bool push(T &&val) noexcept
+        {
+            size_t pos = tail_.load(std::memory_order_relaxed);
+            cell *c;
+
+            while (1) {
+                c = &cells_[pos & mask_];
+
+                size_t seq = c->seq_.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            c->val_ = std::move(val);
+            c->seq_.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief - pop an element, consumer thread only
+         *
+         * @return true on success false if the queue is empty
+         */
+        bool pop(T &val) noexcept
+        {
+            cell *c = &cells_[head_ & mask_];
+
+            if (c->seq_.load(std::memory_order_acquire) != head_ + 1) {
+                return false;
+            }
+
+            val = std::move(c->val_);
+            c->val_ = T();
+            c->seq_.store(head_ + mask_ + 1, std::memory_order_release);
+            head_ ++;
+            return true;
+        }
+
+        size_t capacity() const noexcept { return mask_ + 1; }
+
+    private:
+        struct cell {
+            std::atomic<size_t> seq_;
+            T val_;
+        };
+
+        std::unique_ptr<cell[]> cells_;
+        size_t mask_;
+        alignas(mpsc_queue_cache_line) std::atomic<size_t> tail_{0};
+        alignas(mpsc_queue_cache_line) size_t head_ = 0;
+};
+
+}
+
+#endif
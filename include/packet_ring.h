@@ -0,0 +1,628 @@
+/**
+ * @brief - implements PACKET_MMAP rings of AF_PACKET sockets
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_PACKET_RING_H__
+#define __AUTO_LIB_PACKET_RING_H__
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+// older libc headers lack the qdisc bypass option
+#ifndef PACKET_QDISC_BYPASS
+#define PACKET_QDISC_BYPASS 20
+#endif
+
+namespace auto_os::lib {
+
+// size of a block of the receive ring, a multiple of the page size
+static constexpr uint32_t packet_rx_ring_default_block_size = 1 << 20;
+
+// number of blocks of the receive ring
+static constexpr uint32_t packet_rx_ring_default_n_blocks = 16;
+
+// milliseconds after which the kernel hands out a block that is not full
+static constexpr uint32_t packet_rx_ring_default_block_timeout_msec = 10;
+
+// size of a slot of the transmit ring, header included
+static constexpr uint32_t packet_tx_ring_default_frame_size = 2048;
+
+// number of slots of the transmit ring
+static constexpr uint32_t packet_tx_ring_default_n_frames = 1024;
+
+// size of a block of the transmit ring, the slots are laid out in blocks
+static constexpr uint32_t packet_tx_ring_block_size = 1 << 16;
+
+/**
+ * @brief - implements frame of a receive ring, points into the ring
+ */
+struct packet_frame {
+    // frame from the mac header, valid until the callback returns
+    const uint8_t *data_ = nullptr;
+    // bytes captured
+    uint32_t len_ = 0;
+    // bytes on the wire
+    uint32_t orig_len_ = 0;
+    // receive time
+    uint32_t sec_ = 0;
+    uint32_t nsec_ = 0;
+    // vlan tag stripped by the nic, valid if vlan_valid_ is set
+    uint16_t vlan_tci_ = 0;
+    bool vlan_valid_ = false;
+};
+
+/**
+ * @brief - implements packet ring counters
+ */
+struct packet_ring_stats {
+    // frames seen by the socket, the dropped ones included
+    uint64_t packets_ = 0;
+    // frames dropped because the ring was full
+    uint64_t drops_ = 0;
+    // times the ring was found full and frozen
+    uint64_t freeze_q_cnt_ = 0;
+};
+
+/**
+ * @brief - implements packet_tx_ring counters
+ */
+struct packet_tx_ring_stats {
+    // frames queued on the ring
+    uint64_t queued_ = 0;
+    // send calls made to flush the ring
+    uint64_t flushes_ = 0;
+    // times a frame was asked for while every slot was still owned by the kernel
+    uint64_t ring_full_ = 0;
+    // frames the kernel refused as malformed
+    uint64_t wrong_format_ = 0;
+};
+
+// called with each frame of the ring
+typedef std::function<void(const packet_frame &frame)> packet_frame_fn;
+
+/**
+ * @brief - implements TPACKET_V3 receive ring
+ *
+ * @details - the kernel fills blocks of frames and hands a block out once it is
+ *            full or its timeout expired, frames are read in place with no
+ *            system call per frame. the socket can be watched for readability,
+ *            such as with event_manager::create_socket_event
+ */
+class packet_rx_ring {
+    public:
+        /**
+         * @brief - open a packet socket on an interface with a receive ring
+         *
+         * @param in dev - interface name
+         * @param in ethertype - protocol to receive, ETH_P_ALL for every frame
+         * @param in block_size - size of a block, a multiple of the page size
+         * @param in n_blocks - number of blocks
+         * @param in block_timeout_msec - time after which a block is handed out not full
+         *
+         * This constructor will throw exception.
+         */
+        explicit packet_rx_ring(const std::string dev, uint16_t ethertype = ETH_P_ALL,
+                                uint32_t block_size = packet_rx_ring_default_block_size,
+                                uint32_t n_blocks = packet_rx_ring_default_n_blocks,
+                                uint32_t block_timeout_msec = packet_rx_ring_default_block_timeout_msec);
+
+        /**
+         * @brief - set up a receive ring on an open packet socket, such as raw_socket::get_socket
+         *
+         * @param in fd - packet socket, stays owned by the caller
+         *
+         * @details - frames already queued on the socket are not seen through the ring
+         *
+         * This constructor will throw exception.
+         */
+        explicit packet_rx_ring(int fd,
+                                uint32_t block_size = packet_rx_ring_default_block_size,
+                                uint32_t n_blocks = packet_rx_ring_default_n_blocks,
+                                uint32_t block_timeout_msec = packet_rx_ring_default_block_timeout_msec);
+        ~packet_rx_ring();
+
+        packet_rx_ring(const packet_rx_ring &) = delete;
+        packet_rx_ring &operator=(const packet_rx_ring &) = delete;
+
+        int get_socket() const noexcept { return fd_; }
+
+        /**
+         * @brief - wait until a block is handed out
+         *
+         * @param in timeout_msec - time to wait, -1 for ever
+         *
+         * @return 1 if a block is ready, 0 on timeout, -1 on failure
+         */
+        int wait(int timeout_msec) noexcept;
+
+        /**
+         * @brief - read the frames of the blocks handed out, without waiting
+         *
+         * @param in fn - called with each frame
+         * @param in max_blocks - most blocks to read, 0 for all that are ready
+         *
+         * @details - each block is returned to the kernel after its frames are read
+         *
+         * @return number of frames read
+         */
+        int read(const packet_frame_fn &fn, uint32_t max_blocks = 0);
+
+        /**
+         * @brief - get counters of the socket
+         *
+         * @param out stats - totals since the ring was set up
+         *
+         * @return 0 on success -1 on failure
+         */
+        int get_stats(packet_ring_stats &stats) noexcept;
+
+    private:
+        int fd_ = -1;
+        bool own_fd_ = false;
+        uint8_t *map_ = nullptr;
+        size_t map_size_ = 0;
+        uint32_t block_size_;
+        uint32_t n_blocks_;
+        // next block to be handed out by the kernel
+        uint32_t cur_ = 0;
+        // the kernel resets its counters on each read
+        packet_ring_stats stats_;
+
+        void setup_(uint32_t block_timeout_msec);
+};
+
+inline packet_rx_ring::packet_rx_ring(const std::string dev, uint16_t ethertype,
+                                      uint32_t block_size, uint32_t n_blocks,
+                                      uint32_t block_timeout_msec) :
+                                      block_size_(block_size),
+                                      n_blocks_(n_blocks)
+{
+    struct sockaddr_ll addr = {};
+
+    fd_ = socket(AF_PACKET, static_cast<int>(SOCK_RAW) | SOCK_CLOEXEC, htons(ethertype));
+    if (fd_ < 0) {
+        throw std::runtime_error("failed to open packet socket");
+    }
+    own_fd_ = true;
+
+    try {
+        // the ring is set up before bind, no frame goes to the socket queue instead
+        setup_(block_timeout_msec);
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ethertype);
+    addr.sll_ifindex = if_nametoindex(dev.c_str());
+    if ((addr.sll_ifindex == 0) ||
+        (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+        munmap(map_, map_size_);
+        close(fd_);
+        throw std::runtime_error("failed to bind packet socket to " + dev);
+    }
+}
+
+inline packet_rx_ring::packet_rx_ring(int fd, uint32_t block_size, uint32_t n_blocks,
+                                      uint32_t block_timeout_msec) :
+                                      fd_(fd),
+                                      block_size_(block_size),
+                                      n_blocks_(n_blocks)
+{
+    setup_(block_timeout_msec);
+}
+
+inline packet_rx_ring::~packet_rx_ring()
+{
+    struct tpacket_req3 req = {};
+
+    munmap(map_, map_size_);
+    if (own_fd_) {
+        close(fd_);
+    } else {
+        // the socket goes back to receiving through recvfrom
+        setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+    }
+}
+
+inline void packet_rx_ring::setup_(uint32_t block_timeout_msec)
+{
+    struct tpacket_req3 req = {};
+    int version = TPACKET_V3;
+    // only bounds the frames per block, frames are packed by their real size
+    uint32_t frame_size = TPACKET_ALIGN(2048);
+
+    if ((block_size_ == 0) || (block_size_ % getpagesize()) || (n_blocks_ == 0)) {
+        throw std::runtime_error("invalid packet ring size");
+    }
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        throw std::runtime_error("TPACKET_V3 is not supported");
+    }
+
+    req.tp_block_size = block_size_;
+    req.tp_block_nr = n_blocks_;
+    req.tp_frame_size = frame_size;
+    req.tp_frame_nr = (block_size_ / frame_size) * n_blocks_;
+    req.tp_retire_blk_tov = block_timeout_msec;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        throw std::runtime_error("failed to set up packet rx ring");
+    }
+
+    map_size_ = (size_t)block_size_ * n_blocks_;
+    map_ = static_cast<uint8_t *>(mmap(nullptr, map_size_, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, fd_, 0));
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        req = {};
+        setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+        throw std::runtime_error("failed to map packet rx ring");
+    }
+}
+
+inline int packet_rx_ring::wait(int timeout_msec) noexcept
+{
+    struct tpacket_block_desc *bd = (struct tpacket_block_desc *)(map_ + (size_t)cur_ * block_size_);
+    struct pollfd pfd = {};
+    int ret;
+
+    if (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) {
+        return 1;
+    }
+
+    pfd.fd = fd_;
+    pfd.events = POLLIN | POLLERR;
+    ret = poll(&pfd, 1, timeout_msec);
+    if (ret < 0) {
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    return ret > 0 ? 1 : 0;
+}
+
+inline int packet_rx_ring::read(const packet_frame_fn &fn, uint32_t max_blocks)
+{
+    packet_frame frame;
+    int n_frames = 0;
+
+    for (uint32_t b = 0; (max_blocks == 0) || (b < max_blocks); b ++) {
+        struct tpacket_block_desc *bd = (struct tpacket_block_desc *)(map_ + (size_t)cur_ * block_size_);
+        struct tpacket3_hdr *ph;
+
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            break;
+        }
+
+        ph = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i ++) {
+            frame.data_ = (const uint8_t *)ph + ph->tp_mac;
+            frame.len_ = ph->tp_snaplen;
+            frame.orig_len_ = ph->tp_len;
+            frame.sec_ = ph->tp_sec;
+            frame.nsec_ = ph->tp_nsec;
+            frame.vlan_valid_ = ph->tp_status & TP_STATUS_VLAN_VALID;
+            frame.vlan_tci_ = frame.vlan_valid_ ? ph->hv1.tp_vlan_tci : 0;
+
+            fn(frame);
+            n_frames ++;
+
+            ph = (struct tpacket3_hdr *)((uint8_t *)ph + ph->tp_next_offset);
+        }
+
+        // the block belongs to the kernel again
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        cur_ = (cur_ + 1) % n_blocks_;
+    }
+
+    return n_frames;
+}
+
+inline int packet_rx_ring::get_stats(packet_ring_stats &stats) noexcept
+{
+    struct tpacket_stats_v3 st = {};
+    socklen_t len = sizeof(st);
+
+    if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0) {
+        return -1;
+    }
+
+    stats_.packets_ += st.tp_packets;
+    stats_.drops_ += st.tp_drops;
+    stats_.freeze_q_cnt_ += st.tp_freeze_q_cnt;
+    stats = stats_;
+
+    return 0;
+}
+
+
+/**
+ * @brief - implements TPACKET_V2 transmit ring
+ *
+ * @details - complete ethernet frames are written into the slots of the mapped
+ *            ring, one send call then transmits every slot queued. a slot is
+ *            free again once the kernel sent it
+ */
+class packet_tx_ring {
+    public:
+        /**
+         * @brief - open a packet socket on an interface with a transmit ring
+         *
+         * @param in dev - interface name
+         * @param in frame_size - size of a slot, a frame can take up to max_frame_len of it
+         * @param in n_frames - number of slots, rounded up to fill the blocks
+         * @param in qdisc_bypass - hand frames straight to the driver, skipping the
+         *                          queueing discipline and its shaping and statistics
+         *
+         * @details - the socket receives nothing
+         *
+         * This constructor will throw exception.
+         */
+        explicit packet_tx_ring(const std::string dev,
+                                uint32_t frame_size = packet_tx_ring_default_frame_size,
+                                uint32_t n_frames = packet_tx_ring_default_n_frames,
+                                bool qdisc_bypass = false);
+
+        /**
+         * @brief - set up a transmit ring on an open and bound packet socket,
+         *          such as raw_socket::get_socket
+         *
+         * @param in fd - packet socket, stays owned by the caller
+         *
+         * This constructor will throw exception.
+         */
+        explicit packet_tx_ring(int fd,
+                                uint32_t frame_size = packet_tx_ring_default_frame_size,
+                                uint32_t n_frames = packet_tx_ring_default_n_frames,
+                                bool qdisc_bypass = false);
+        ~packet_tx_ring();
+
+        packet_tx_ring(const packet_tx_ring &) = delete;
+        packet_tx_ring &operator=(const packet_tx_ring &) = delete;
+
+        int get_socket() const noexcept { return fd_; }
+
+        /**
+         * @brief - returns largest frame a slot takes
+         */
+        size_t max_frame_len() const noexcept { return frame_size_ - data_off_; }
+
+        /**
+         * @brief - get the next free slot to build a frame in
+         *
+         * @return slot of max_frame_len bytes, nullptr if the kernel still owns every slot
+         */
+        uint8_t *get_frame() noexcept;
+
+        /**
+         * @brief - queue the frame built in the slot returned by get_frame
+         *
+         * @param in len - length of the frame from the mac header
+         *
+         * @return 0 on success -1 on invalid length
+         */
+        int commit(size_t len) noexcept;
+
+        /**
+         * @brief - copy a frame into the next free slot and queue it
+         *
+         * @param in frame - ethernet frame
+         * @param in len - length of frame
+         *
+         * @return 0 on success -1 on failure, errno ENOBUFS if the ring is full, flush and retry
+         */
+        int queue(const uint8_t *frame, size_t len) noexcept;
+
+        /**
+         * @brief - transmit the frames queued
+         *
+         * @param in wait - wait until every frame queued is sent, else the kernel
+         *                  sends what the device takes now
+         *
+         * @return number of bytes sent, -1 on failure
+         */
+        int flush(bool wait = true) noexcept;
+
+        packet_tx_ring_stats get_stats() const noexcept { return stats_; }
+
+    private:
+        int fd_ = -1;
+        bool own_fd_ = false;
+        uint8_t *map_ = nullptr;
+        size_t map_size_ = 0;
+        uint32_t frame_size_;
+        uint32_t frames_per_block_;
+        uint32_t n_frames_;
+        // offset of the frame in a slot
+        uint32_t data_off_;
+        // next slot to fill
+        uint32_t cur_ = 0;
+        packet_tx_ring_stats stats_;
+
+        void setup_(uint32_t n_frames, bool qdisc_bypass);
+        struct tpacket2_hdr *slot_(uint32_t idx) const
+        {
+            return (struct tpacket2_hdr *)(map_ +
+                        (size_t)(idx / frames_per_block_) * packet_tx_ring_block_size +
+                        (size_t)(idx % frames_per_block_) * frame_size_);
+        }
+};
+
+inline packet_tx_ring::packet_tx_ring(const std::string dev, uint32_t frame_size,
+                                      uint32_t n_frames, bool qdisc_bypass) :
+                                      frame_size_(frame_size)
+{
+    struct sockaddr_ll addr = {};
+
+    // protocol 0, nothing is received on the socket
+    fd_ = socket(AF_PACKET, static_cast<int>(SOCK_RAW) | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        throw std::runtime_error("failed to open packet socket");
+    }
+    own_fd_ = true;
+
+    addr.sll_family = AF_PACKET;
+    addr.sll_ifindex = if_nametoindex(dev.c_str());
+    if ((addr.sll_ifindex == 0) ||
+        (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+        close(fd_);
+        throw std::runtime_error("failed to bind packet socket to " + dev);
+    }
+
+    try {
+        setup_(n_frames, qdisc_bypass);
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+}
+
+inline packet_tx_ring::packet_tx_ring(int fd, uint32_t frame_size, uint32_t n_frames,
+                                      bool qdisc_bypass) :
+                                      fd_(fd),
+                                      frame_size_(frame_size)
+{
+    setup_(n_frames, qdisc_bypass);
+}
+
+inline packet_tx_ring::~packet_tx_ring()
+{
+    struct tpacket_req req = {};
+
+    munmap(map_, map_size_);
+    if (own_fd_) {
+        close(fd_);
+    } else {
+        setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+    }
+}
+
+inline void packet_tx_ring::setup_(uint32_t n_frames, bool qdisc_bypass)
+{
+    struct tpacket_req req = {};
+    int version = TPACKET_V2;
+    int on = 1;
+    uint32_t n_blocks;
+
+    data_off_ = TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+    if ((frame_size_ % TPACKET_ALIGNMENT) || (frame_size_ <= data_off_) ||
+        (frame_size_ > packet_tx_ring_block_size) || (n_frames == 0)) {
+        throw std::runtime_error("invalid packet ring size");
+    }
+
+    frames_per_block_ = packet_tx_ring_block_size / frame_size_;
+    n_blocks = (n_frames + frames_per_block_ - 1) / frames_per_block_;
+    n_frames_ = n_blocks * frames_per_block_;
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        throw std::runtime_error("TPACKET_V2 is not supported");
+    }
+
+    if (qdisc_bypass &&
+        (setsockopt(fd_, SOL_PACKET, PACKET_QDISC_BYPASS, &on, sizeof(on)) < 0)) {
+        throw std::runtime_error("PACKET_QDISC_BYPASS is not supported");
+    }
+
+    req.tp_block_size = packet_tx_ring_block_size;
+    req.tp_block_nr = n_blocks;
+    req.tp_frame_size = frame_size_;
+    req.tp_frame_nr = n_frames_;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        throw std::runtime_error("failed to set up packet tx ring");
+    }
+
+    map_size_ = (size_t)packet_tx_ring_block_size * n_blocks;
+    map_ = static_cast<uint8_t *>(mmap(nullptr, map_size_, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, fd_, 0));
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        req = {};
+        setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+        throw std::runtime_error("failed to map packet tx ring");
+    }
+}
+
+inline uint8_t *packet_tx_ring::get_frame() noexcept
+{
+    struct tpacket2_hdr *hdr = slot_(cur_);
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+
+    // a refused frame is dropped, its slot is reused
+    if (status & TP_STATUS_WRONG_FORMAT) {
+        stats_.wrong_format_ ++;
+        status = TP_STATUS_AVAILABLE;
+        __atomic_store_n(&hdr->tp_status, status, __ATOMIC_RELAXED);
+    }
+
+    if (status != TP_STATUS_AVAILABLE) {
+        stats_.ring_full_ ++;
+        return nullptr;
+    }
+
+    return (uint8_t *)hdr + data_off_;
+}
+
+inline int packet_tx_ring::commit(size_t len) noexcept
+{
+    struct tpacket2_hdr *hdr = slot_(cur_);
+
+    if ((len == 0) || (len > max_frame_len())) {
+        return -1;
+    }
+
+    hdr->tp_len = len;
+    // the frame is written before the kernel may see the slot
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    cur_ = (cur_ + 1) % n_frames_;
+    stats_.queued_ ++;
+    return 0;
+}
+
+inline int packet_tx_ring::queue(const uint8_t *frame, size_t len) noexcept
+{
+    uint8_t *slot;
+
+    if ((len == 0) || (len > max_frame_len())) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    slot = get_frame();
+    if (!slot) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    memcpy(slot, frame, len);
+    return commit(len);
+}
+
+inline int packet_tx_ring::flush(bool wait) noexcept
+{
+    int ret;
+
+    stats_.flushes_ ++;
+    ret = send(fd_, nullptr, 0, wait ? 0 : MSG_DONTWAIT);
+    if ((ret < 0) && !wait && ((errno == EAGAIN) || (errno == ENOBUFS))) {
+        return 0;
+    }
+
+    return ret;
+}
+}
+
+#endif
@@ -0,0 +1,285 @@
+/**
+ * @brief - implements pool of refcounted receive buffers
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_RX_BUFFER_POOL_H__
+#define __AUTO_LIB_RX_BUFFER_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace auto_os::lib {
+
+// size of a buffer of the pool by default
+static constexpr size_t rx_buffer_pool_default_buf_size = 4096;
+
+// buffers added to the pool at once by default
+static constexpr size_t rx_buffer_pool_default_slab_bufs = 64;
+
+class rx_buffer_pool;
+
+/**
+ * @brief - implements buffer of the pool, shared by the rx_buffer copies referring to it
+ */
+struct rx_buffer_slot {
+    std::atomic<uint32_t> refs_{0};
+    uint8_t *data_ = nullptr;
+    rx_buffer_pool *pool_ = nullptr;
+    // index in the slots of the pool, -1 for a buffer allocated outside it
+    int idx_ = -1;
+};
+
+/**
+ * @brief - implements reference to a buffer of the pool
+ *
+ * @details - copies share the buffer, it goes back to the pool once the last
+ *            reference is released or destroyed. references may be released
+ *            on any thread, a reference itself is not thread safe
+ */
+class rx_buffer {
+    public:
+        rx_buffer() = default;
+        ~rx_buffer() { release(); }
+
+        rx_buffer(const rx_buffer &other) : slot_(other.slot_), len_(other.len_)
+        {
+            if (slot_) {
+                slot_->refs_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        rx_buffer(rx_buffer &&other) noexcept : slot_(other.slot_), len_(other.len_)
+        {
+            other.slot_ = nullptr;
+            other.len_ = 0;
+        }
+
+        rx_buffer &operator=(const rx_buffer &other)
+        {
+            if (this != &other) {
+                rx_buffer copy(other);
+
+                *this = std::move(copy);
+            }
+            return *this;
+        }
+
+        rx_buffer &operator=(rx_buffer &&other) noexcept
+        {
+            if (this != &other) {
+                release();
+                slot_ = other.slot_;
+                len_ = other.len_;
+                other.slot_ = nullptr;
+                other.len_ = 0;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief - returns false if the reference holds no buffer
+         */
+        bool valid() const { return slot_ != nullptr; }
+
+        uint8_t *data() const { return slot_ ? slot_->data_ : nullptr; }
+
+        /**
+         * @brief - returns number of bytes received into the buffer
+         */
+        size_t size() const { return len_; }
+
+        /**
+         * @brief - set number of bytes received into the buffer
+         */
+        void set_size(size_t len) { len_ = len; }
+
+        /**
+         * @brief - returns size of the buffer
+         */
+        size_t capacity() const;
+
+        /**
+         * @brief - drop the reference, the last one returns the buffer to the pool
+         */
+        void release();
+
+    private:
+        friend class rx_buffer_pool;
+
+        explicit rx_buffer(rx_buffer_slot *slot) : slot_(slot) { }
+
+        rx_buffer_slot *slot_ = nullptr;
+        size_t len_ = 0;
+};
+
+/**
+ * @brief - implements rx_buffer_pool counters
+ */
+struct rx_buffer_pool_stats {
+    // buffers of the pool, free or handed out
+    size_t n_bufs_ = 0;
+    // buffers handed out and not returned yet
+    size_t in_use_ = 0;
+    // buffers allocated outside the pool because it reached its bound
+    uint64_t overflows_ = 0;
+};
+
+/**
+ * @brief - implements slab pool of fixed size receive buffers
+ *
+ * @details - buffers are carved out of slabs of slab_bufs buffers, a slab is
+ *            added when the pool runs empty. get is called on the thread
+ *            receiving, buffers may be returned from any thread. the pool
+ *            must outlive every buffer handed out
+ */
+class rx_buffer_pool {
+    public:
+        /**
+         * @brief - create pool
+         *
+         * @param in buf_size - size of each buffer
+         * @param in slab_bufs - buffers added to the pool at once, the first slab is added here
+         * @param in max_bufs - bound of the pool, 0 for no bound. beyond it buffers are
+         *                      allocated one by one and freed on return
+         */
+        explicit rx_buffer_pool(size_t buf_size = rx_buffer_pool_default_buf_size,
+                                size_t slab_bufs = rx_buffer_pool_default_slab_bufs,
+                                size_t max_bufs = 0) :
+                                buf_size_(buf_size),
+                                slab_bufs_(slab_bufs ? slab_bufs : 1),
+                                max_bufs_(max_bufs)
+        {
+            add_slab_();
+        }
+        ~rx_buffer_pool() = default;
+
+        rx_buffer_pool(const rx_buffer_pool &) = delete;
+        rx_buffer_pool &operator=(const rx_buffer_pool &) = delete;
+
+        /**
+         * @brief - get a free buffer, size is 0
+         *
+         * @return buffer, invalid only if the memory is exhausted
+         */
+        rx_buffer get();
+
+        size_t buf_size() const { return buf_size_; }
+
+        rx_buffer_pool_stats get_stats()
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+
+            stats_.n_bufs_ = slots_.size();
+            stats_.in_use_ = slots_.size() - free_.size();
+            return stats_;
+        }
+
+    private:
+        friend class rx_buffer;
+
+        size_t buf_size_;
+        size_t slab_bufs_;
+        size_t max_bufs_;
+        std::mutex lock_;
+        std::vector<std::unique_ptr<uint8_t[]>> slabs_;
+        // a deque keeps the slots in place as slabs are added
+        std::deque<rx_buffer_slot> slots_;
+        std::vector<uint32_t> free_;
+        rx_buffer_pool_stats stats_;
+
+        void add_slab_();
+        void put_(rx_buffer_slot *slot);
+};
+
+inline size_t rx_buffer::capacity() const
+{
+    return slot_ ? slot_->pool_->buf_size() : 0;
+}
+
+inline void rx_buffer::release()
+{
+    if (slot_ && (slot_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)) {
+        slot_->pool_->put_(slot_);
+    }
+
+    slot_ = nullptr;
+    len_ = 0;
+}
+
+inline void rx_buffer_pool::add_slab_()
+{
+    size_t n_bufs = slab_bufs_;
+
+    if (max_bufs_ > 0) {
+        n_bufs = std::min(n_bufs, max_bufs_ - slots_.size());
+    }
+    if (n_bufs == 0) {
+        return;
+    }
+
+    slabs_.push_back(std::make_unique<uint8_t[]>(n_bufs * buf_size_));
+
+    for (size_t i = 0; i < n_bufs; i ++) {
+        rx_buffer_slot &slot = slots_.emplace_back();
+
+        slot.data_ = slabs_.back().get() + i * buf_size_;
+        slot.pool_ = this;
+        slot.idx_ = slots_.size() - 1;
+        free_.push_back(slot.idx_);
+    }
+}
+
+inline rx_buffer rx_buffer_pool::get()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    rx_buffer_slot *slot;
+
+    if (free_.empty()) {
+        add_slab_();
+    }
+
+    if (free_.empty()) {
+        // bound reached, the buffer lives until its last reference is gone
+        slot = new (std::nothrow) rx_buffer_slot();
+        if (!slot) {
+            return rx_buffer();
+        }
+        slot->data_ = new (std::nothrow) uint8_t[buf_size_];
+        if (!slot->data_) {
+            delete slot;
+            return rx_buffer();
+        }
+        slot->pool_ = this;
+        stats_.overflows_ ++;
+    } else {
+        slot = &slots_[free_.back()];
+        free_.pop_back();
+    }
+
+    slot->refs_.store(1, std::memory_order_relaxed);
+    return rx_buffer(slot);
+}
+
+inline void rx_buffer_pool::put_(rx_buffer_slot *slot)
+{
+    if (slot->idx_ < 0) {
+        delete[] slot->data_;
+        delete slot;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    free_.push_back(slot->idx_);
+}
+
+}
+
+#endif
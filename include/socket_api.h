@@ -11,6 +11,30 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <climits>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
+
+// older libc headers lack the UDP offload options
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
 
 namespace auto_os::lib {
 
@@ -56,6 +80,78 @@ class socket_utils {
         int set_multicast(int fd, const std::string &mcast_group, const std::string &if_ip);
 };
 
+/**
+ * @brief - send scattered buffers on a stream socket
+ *
+ * @param in fd - socket
+ * @param inout iov - buffers, advanced past the bytes sent so the rest can be sent again
+ * @param in iovcnt - number of buffers
+ *
+ * @details - partial writes are continued until everything is sent or the socket
+ *            would block
+ *
+ * @return number of bytes sent, -1 on failure with nothing sent
+ */
+inline int socket_sendv(int fd, struct iovec *iov, int iovcnt) noexcept
+{
+    struct msghdr msg = {};
+    size_t sent = 0;
+    ssize_t ret;
+
+    while (iovcnt > 0) {
+        // skip the buffers already sent and the empty ones
+        if (iov->iov_len == 0) {
+            iov ++;
+            iovcnt --;
+            continue;
+        }
+
+        msg.msg_iov = iov;
+        msg.msg_iovlen = std::min(iovcnt, IOV_MAX);
+
+        ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return sent ? (int)sent : -1;
+        }
+
+        sent += ret;
+        while ((iovcnt > 0) && ((size_t)ret >= iov->iov_len)) {
+            ret -= iov->iov_len;
+            iov->iov_len = 0;
+            iov ++;
+            iovcnt --;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return sent;
+}
+
+/**
+ * @brief - receive into scattered buffers with one system call
+ *
+ * @param in fd - socket
+ * @param in iov - buffers, filled in order
+ * @param in iovcnt - number of buffers
+ *
+ * @return number of bytes received, 0 on peer close, -1 on failure
+ */
+inline int socket_recvv(int fd, struct iovec *iov, int iovcnt) noexcept
+{
+    struct msghdr msg = {};
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = std::min(iovcnt, IOV_MAX);
+
+    return recvmsg(fd, &msg, 0);
+}
+
 /**
  * @brief - implements tcp connection class
  */
@@ -130,6 +226,32 @@ class tcp_conn {
          * @return number of bytes on success -1 on failure
          */
         int recv_msg(char *data, size_t data_len);
+
+        /**
+         * @brief - send header, payload and trailer from separate buffers without copying
+         *
+         * @param inout iov - buffers, advanced past the bytes sent
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes sent, less than the total if the socket would block, -1 on failure
+         */
+        int sendv(struct iovec *iov, int iovcnt)
+        {
+            return socket_sendv(fd_, iov, iovcnt);
+        }
+
+        /**
+         * @brief - receive into separate buffers with one system call
+         *
+         * @param in iov - buffers, filled in order
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes received, 0 on peer close, -1 on failure
+         */
+        int recvv(struct iovec *iov, int iovcnt)
+        {
+            return socket_recvv(fd_, iov, iovcnt);
+        }
     private:
         int fd_;
         std::string ipaddr_;
@@ -151,6 +273,50 @@ class tcp_server {
         int fd_;
 };
 
+/**
+ * @brief - get accept queue of a listening tcp socket
+ *
+ * @param in fd - listening socket
+ * @param out len - connections waiting to be accepted
+ * @param out max - backlog, handshakes are dropped once len exceeds it
+ *
+ * @return 0 on success -1 on failure
+ */
+inline int tcp_accept_queue(int fd, uint32_t &len, uint32_t &max) noexcept
+{
+    struct tcp_info info = {};
+    socklen_t info_len = sizeof(info);
+
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) < 0) {
+        return -1;
+    }
+
+    // a listener reports its accept queue in these two
+    len = info.tcpi_unacked;
+    max = info.tcpi_sacked;
+    return 0;
+}
+
+/**
+ * @brief - returns milliseconds an accepted connection waited in the accept queue, -1 on failure
+ *
+ * @param in fd - socket just returned by accept
+ *
+ * @details - time since the last ack of the handshake, in jiffies resolution.
+ *            underestimated if the peer sent data before the accept
+ */
+inline int tcp_accept_wait_msec(int fd) noexcept
+{
+    struct tcp_info info = {};
+    socklen_t info_len = sizeof(info);
+
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) < 0) {
+        return -1;
+    }
+
+    return info.tcpi_last_ack_recv;
+}
+
 /**
  * @brief - implements tcp client
  */
@@ -164,10 +330,493 @@ class tcp_client {
         int send_msg(char *data, size_t data_len);
         int recv_msg(uint8_t *data, size_t data_len);
         int recv_msg(char *data, size_t data_len);
+
+        /**
+         * @brief - send header, payload and trailer from separate buffers without copying
+         *
+         * @param inout iov - buffers, advanced past the bytes sent
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes sent, less than the total if the socket would block, -1 on failure
+         */
+        int sendv(struct iovec *iov, int iovcnt)
+        {
+            return socket_sendv(fd_, iov, iovcnt);
+        }
+
+        /**
+         * @brief - receive into separate buffers with one system call
+         *
+         * @param in iov - buffers, filled in order
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes received, 0 on peer close, -1 on failure
+         */
+        int recvv(struct iovec *iov, int iovcnt)
+        {
+            return socket_recvv(fd_, iov, iovcnt);
+        }
     private:
         int fd_;
 };
 
+/**
+ * @brief - implements peer address resolved once, reused on every send
+ *
+ * @details - holds an IPv4, IPv6 or unix socket address. sending to it does
+ *            no parsing and no allocation
+ */
+class net_endpoint {
+    public:
+        explicit net_endpoint() = default;
+
+        /**
+         * @brief - resolve an IPv4 or IPv6 address and port
+         *
+         * This constructor will throw exception.
+         */
+        explicit net_endpoint(const std::string &ipaddr, int port)
+        {
+            if (set(ipaddr, port) < 0) {
+                throw std::runtime_error("invalid address " + ipaddr);
+            }
+        }
+
+        /**
+         * @brief - resolve a unix socket path
+         *
+         * This constructor will throw exception.
+         */
+        explicit net_endpoint(const std::string &path)
+        {
+            if (set_unix(path) < 0) {
+                throw std::runtime_error("invalid unix socket path " + path);
+            }
+        }
+
+        /**
+         * @brief - set IPv4 or IPv6 address and port
+         *
+         * @param in ipaddr - numeric address, no name lookup is done
+         * @param in port - port
+         *
+         * @return 0 on success -1 on invalid address
+         */
+        int set(const std::string &ipaddr, int port) noexcept
+        {
+            struct sockaddr_in *in4 = reinterpret_cast<struct sockaddr_in *>(&addr_);
+            struct sockaddr_in6 *in6 = reinterpret_cast<struct sockaddr_in6 *>(&addr_);
+
+            addr_ = {};
+            len_ = 0;
+
+            if ((port < 0) || (port > 65535)) {
+                return -1;
+            }
+
+            if (inet_pton(AF_INET, ipaddr.c_str(), &in4->sin_addr) == 1) {
+                in4->sin_family = AF_INET;
+                in4->sin_port = htons(port);
+                len_ = sizeof(*in4);
+                return 0;
+            }
+
+            if (inet_pton(AF_INET6, ipaddr.c_str(), &in6->sin6_addr) == 1) {
+                in6->sin6_family = AF_INET6;
+                in6->sin6_port = htons(port);
+                len_ = sizeof(*in6);
+                return 0;
+            }
+
+            addr_ = {};
+            return -1;
+        }
+
+        /**
+         * @brief - set unix socket path
+         *
+         * @param in path - socket path
+         *
+         * @return 0 on success -1 if the path is too long
+         */
+        int set_unix(const std::string &path) noexcept
+        {
+            struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un *>(&addr_);
+
+            addr_ = {};
+            len_ = 0;
+
+            if (path.empty() || (path.size() >= sizeof(un->sun_path))) {
+                return -1;
+            }
+
+            un->sun_family = AF_UNIX;
+            memcpy(un->sun_path, path.c_str(), path.size());
+            len_ = offsetof(struct sockaddr_un, sun_path) + path.size() + 1;
+            return 0;
+        }
+
+        /**
+         * @brief - returns true once an address is set
+         */
+        bool valid() const noexcept { return len_ > 0; }
+
+        int family() const noexcept { return addr_.ss_family; }
+        const struct sockaddr *addr() const noexcept { return reinterpret_cast<const struct sockaddr *>(&addr_); }
+        socklen_t len() const noexcept { return len_; }
+
+    private:
+        struct sockaddr_storage addr_ = {};
+        socklen_t len_ = 0;
+};
+
+/**
+ * @brief - send to a resolved endpoint
+ *
+ * @return number of bytes on success -1 on failure
+ */
+inline int net_endpoint_send(int fd, const net_endpoint &ep, const uint8_t *data, size_t data_len) noexcept
+{
+    if (!ep.valid()) {
+        errno = EDESTADDRREQ;
+        return -1;
+    }
+
+    return sendto(fd, data, data_len, 0, ep.addr(), ep.len());
+}
+
+/**
+ * @brief - connect a datagram socket to an endpoint, send then needs no address
+ *
+ * @return 0 on success -1 on failure
+ */
+inline int net_endpoint_connect(int fd, const net_endpoint &ep) noexcept
+{
+    if (!ep.valid()) {
+        errno = EDESTADDRREQ;
+        return -1;
+    }
+
+    return connect(fd, ep.addr(), ep.len());
+}
+
+// datagrams moved per recvmmsg / sendmmsg call
+static constexpr int udp_batch_max = 64;
+
+/**
+ * @brief - implements one datagram of a batch, buffers are owned by the caller
+ */
+struct udp_msg {
+    // buffer to receive into or data to send
+    uint8_t *data_ = nullptr;
+    // size of the buffer on receive, bytes to send on send
+    size_t data_len_ = 0;
+    // bytes received or sent
+    size_t len_ = 0;
+    // sender on receive, target on send. left zeroed on send for a connected socket
+    struct sockaddr_in addr_ = {};
+};
+
+/**
+ * @brief - receive a batch of datagrams with recvmmsg
+ *
+ * @param in fd - udp socket
+ * @param inout msgs - datagrams, data_ and data_len_ set by the caller
+ * @param in n_msgs - number of datagrams
+ * @param in flags - MSG_DONTWAIT to return what is queued without blocking
+ *
+ * @return number of datagrams received, 0 if none is queued, -1 on failure
+ */
+inline int udp_recv_batch(int fd, udp_msg *msgs, int n_msgs, int flags) noexcept
+{
+    struct mmsghdr hdrs[udp_batch_max];
+    struct iovec iovs[udp_batch_max];
+    int n = std::min(n_msgs, udp_batch_max);
+    int ret;
+    int i;
+
+    for (i = 0; i < n; i ++) {
+        iovs[i].iov_base = msgs[i].data_;
+        iovs[i].iov_len = msgs[i].data_len_;
+        hdrs[i].msg_hdr = {};
+        hdrs[i].msg_hdr.msg_name = &msgs[i].addr_;
+        hdrs[i].msg_hdr.msg_namelen = sizeof(msgs[i].addr_);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    ret = recvmmsg(fd, hdrs, n, flags, nullptr);
+    if (ret < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+
+    for (i = 0; i < ret; i ++) {
+        msgs[i].len_ = hdrs[i].msg_len;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief - send a batch of datagrams with sendmmsg
+ *
+ * @param in fd - udp socket
+ * @param inout msgs - datagrams with data_, data_len_ and addr_ set by the caller
+ * @param in n_msgs - number of datagrams
+ *
+ * @return number of datagrams sent, the rest was not sent, -1 on failure
+ */
+inline int udp_send_batch(int fd, udp_msg *msgs, int n_msgs) noexcept
+{
+    struct mmsghdr hdrs[udp_batch_max];
+    struct iovec iovs[udp_batch_max];
+    int sent = 0;
+    int ret;
+    int i;
+
+    while (sent < n_msgs) {
+        int n = std::min(n_msgs - sent, udp_batch_max);
+
+        for (i = 0; i < n; i ++) {
+            udp_msg &m = msgs[sent + i];
+
+            iovs[i].iov_base = m.data_;
+            iovs[i].iov_len = m.data_len_;
+            hdrs[i].msg_hdr = {};
+            if (m.addr_.sin_family != AF_UNSPEC) {
+                hdrs[i].msg_hdr.msg_name = &m.addr_;
+                hdrs[i].msg_hdr.msg_namelen = sizeof(m.addr_);
+            }
+            hdrs[i].msg_hdr.msg_iov = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ret = sendmmsg(fd, hdrs, n, 0);
+        if (ret < 0) {
+            return sent ? sent : -1;
+        }
+
+        for (i = 0; i < ret; i ++) {
+            msgs[sent + i].len_ = hdrs[i].msg_len;
+        }
+
+        sent += ret;
+        if (ret < n) {
+            break;
+        }
+    }
+
+    return sent;
+}
+
+// segments the kernel accepts in one UDP_SEGMENT send
+static constexpr size_t udp_gso_max_segments = 64;
+
+// largest udp payload of one send, segments included
+static constexpr size_t udp_gso_max_payload = 65507;
+
+/**
+ * @brief - returns true if the kernel knows UDP_SEGMENT, probed once on a scratch socket
+ */
+inline bool udp_gso_supported()
+{
+    static const bool supported = []() {
+        int seg = 1200;
+        int fd = socket(AF_INET, static_cast<int>(SOCK_DGRAM) | SOCK_CLOEXEC, 0);
+        int ret;
+
+        if (fd < 0) {
+            return false;
+        }
+
+        ret = setsockopt(fd, SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg));
+        close(fd);
+
+        return ret == 0;
+    }();
+
+    return supported;
+}
+
+/**
+ * @brief - send one datagram per segment with sendmmsg, used where UDP_SEGMENT is refused
+ */
+inline int udp_send_segments(int fd, const net_endpoint *ep, const uint8_t *data,
+                             size_t data_len, uint16_t segment_size) noexcept
+{
+    struct mmsghdr hdrs[udp_batch_max];
+    struct iovec iovs[udp_batch_max];
+    size_t off = 0;
+    int ret;
+    int n;
+
+    while (off < data_len) {
+        for (n = 0; (n < udp_batch_max) && (off + n * segment_size < data_len); n ++) {
+            size_t seg_off = off + n * segment_size;
+
+            iovs[n].iov_base = const_cast<uint8_t *>(data + seg_off);
+            iovs[n].iov_len = std::min<size_t>(segment_size, data_len - seg_off);
+            hdrs[n].msg_hdr = {};
+            if (ep) {
+                hdrs[n].msg_hdr.msg_name = const_cast<struct sockaddr *>(ep->addr());
+                hdrs[n].msg_hdr.msg_namelen = ep->len();
+            }
+            hdrs[n].msg_hdr.msg_iov = &iovs[n];
+            hdrs[n].msg_hdr.msg_iovlen = 1;
+        }
+
+        ret = sendmmsg(fd, hdrs, n, 0);
+        if (ret <= 0) {
+            return off ? (int)off : -1;
+        }
+
+        for (int i = 0; i < ret; i ++) {
+            off += hdrs[i].msg_len;
+        }
+        if (ret < n) {
+            break;
+        }
+    }
+
+    return off;
+}
+
+/**
+ * @brief - send a buffer as equal sized datagrams with UDP_SEGMENT
+ *
+ * @param in fd - udp socket
+ * @param in ep - target, nullptr for a connected socket
+ * @param in data - data, cut into segment_size datagrams, the last one may be shorter
+ * @param in data_len - length of data
+ * @param in segment_size - payload of each datagram
+ *
+ * @details - the kernel segments up to udp_gso_max_segments datagrams per system call.
+ *            where the kernel lacks UDP_SEGMENT, or the device of this socket's route
+ *            refuses it, the datagrams go out with sendmmsg. a segment size the kernel
+ *            rejects fails with EINVAL
+ *
+ * @return number of bytes sent, -1 on failure
+ */
+inline int udp_send_gso(int fd, const net_endpoint *ep, const uint8_t *data,
+                        size_t data_len, uint16_t segment_size) noexcept
+{
+    alignas(struct cmsghdr) char ctrl[CMSG_SPACE(sizeof(uint16_t))] = {};
+    size_t chunk = segment_size * std::min(udp_gso_max_segments, udp_gso_max_payload / std::max<size_t>(segment_size, 1));
+    struct cmsghdr *cm;
+    struct msghdr msg = {};
+    struct iovec iov;
+    size_t off = 0;
+    ssize_t ret;
+
+    if ((segment_size == 0) || (chunk == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!udp_gso_supported()) {
+        return udp_send_segments(fd, ep, data, data_len, segment_size);
+    }
+
+    if (ep) {
+        msg.msg_name = const_cast<struct sockaddr *>(ep->addr());
+        msg.msg_namelen = ep->len();
+    }
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    while (off < data_len) {
+        iov.iov_base = const_cast<uint8_t *>(data + off);
+        iov.iov_len = std::min(chunk, data_len - off);
+
+        // a single segment needs no offload
+        if (iov.iov_len > segment_size) {
+            msg.msg_control = ctrl;
+            msg.msg_controllen = sizeof(ctrl);
+            cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+        } else {
+            msg.msg_control = nullptr;
+            msg.msg_controllen = 0;
+        }
+
+        ret = sendmsg(fd, &msg, 0);
+        if (ret < 0) {
+            // the device of this socket cannot offload, only this send goes out unsegmented.
+            // EINVAL is a bad segment size or count and is the caller's to see
+            if (msg.msg_control && ((errno == EIO) || (errno == ENOPROTOOPT) || (errno == EOPNOTSUPP))) {
+                ret = udp_send_segments(fd, ep, data + off, data_len - off, segment_size);
+                return (ret < 0) ? (off ? (int)off : -1) : (int)(off + ret);
+            }
+            return off ? (int)off : -1;
+        }
+
+        off += ret;
+    }
+
+    return off;
+}
+
+/**
+ * @brief - let the kernel coalesce received datagrams of one flow with UDP_GRO
+ *
+ * @return 0 on success -1 if not supported
+ */
+inline int udp_enable_gro(int fd) noexcept
+{
+    int on = 1;
+
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+}
+
+/**
+ * @brief - receive a possibly coalesced datagram
+ *
+ * @param in fd - udp socket
+ * @param inout msg - data_ and data_len_ set by the caller, size it for 64 KB to get whole trains
+ * @param out segment_size - size of each coalesced datagram, the last one may be shorter
+ * @param in flags - MSG_DONTWAIT to not block
+ *
+ * @return number of bytes received, 0 if nothing is queued, -1 on failure
+ */
+inline int udp_recv_gro(int fd, udp_msg &msg, uint16_t &segment_size, int flags) noexcept
+{
+    alignas(struct cmsghdr) char ctrl[CMSG_SPACE(sizeof(int))];
+    struct msghdr hdr = {};
+    struct iovec iov;
+    struct cmsghdr *cm;
+    ssize_t ret;
+
+    iov.iov_base = msg.data_;
+    iov.iov_len = msg.data_len_;
+    hdr.msg_name = &msg.addr_;
+    hdr.msg_namelen = sizeof(msg.addr_);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = ctrl;
+    hdr.msg_controllen = sizeof(ctrl);
+
+    ret = recvmsg(fd, &hdr, flags);
+    if (ret < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+
+    msg.len_ = ret;
+    segment_size = ret;
+    for (cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+        if ((cm->cmsg_level == SOL_UDP) && (cm->cmsg_type == UDP_GRO)) {
+            int gso_size;
+
+            memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+            segment_size = gso_size;
+        }
+    }
+
+    return ret;
+}
+
 /**
  * @brief - implements udp server
  */
@@ -179,6 +828,118 @@ class udp_server {
         int get_socket() const noexcept;
         int send_msg(const std::string addr, int port, uint8_t *data, size_t data_len) noexcept;
         int recv_msg(std::string &addr, int &port, uint8_t *data, size_t data_len) noexcept;
+
+        /**
+         * @brief - send datagrams in one system call per udp_batch_max of them
+         *
+         * @param inout msgs - datagrams with their target in binary form
+         * @param in n_msgs - number of datagrams
+         *
+         * @return number of datagrams sent, -1 on failure
+         */
+        int send_batch(udp_msg *msgs, int n_msgs) noexcept
+        {
+            return udp_send_batch(fd_, msgs, n_msgs);
+        }
+
+        /**
+         * @brief - receive up to udp_batch_max datagrams in one system call
+         *
+         * @param inout msgs - datagrams, sender filled in binary form
+         * @param in n_msgs - number of datagrams
+         * @param in flags - MSG_DONTWAIT to not block
+         *
+         * @return number of datagrams received, 0 if none is queued, -1 on failure
+         */
+        int recv_batch(udp_msg *msgs, int n_msgs, int flags = MSG_DONTWAIT) noexcept
+        {
+            return udp_recv_batch(fd_, msgs, n_msgs, flags);
+        }
+
+        /**
+         * @brief - send to an endpoint resolved beforehand, no parsing on the send path
+         *
+         * @param in ep - target, of the same family as the socket
+         * @param in data - data to send
+         * @param in data_len - length of data
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(const net_endpoint &ep, uint8_t *data, size_t data_len) noexcept
+        {
+            return net_endpoint_send(fd_, ep, data, data_len);
+        }
+
+        /**
+         * @brief - connect to an endpoint, the kernel then skips the route lookup per send
+         *
+         * @param in ep - peer, only datagrams from it are received afterwards
+         *
+         * @return 0 on success -1 on failure
+         */
+        int connect_to(const net_endpoint &ep) noexcept
+        {
+            return net_endpoint_connect(fd_, ep);
+        }
+
+        /**
+         * @brief - send to the connected endpoint
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(uint8_t *data, size_t data_len) noexcept
+        {
+            return send(fd_, data, data_len, 0);
+        }
+
+        /**
+         * @brief - send a buffer as segment_size datagrams, 64 KB per system call with UDP_SEGMENT
+         *
+         * @param in ep - target
+         * @param in data - data to send
+         * @param in data_len - length of data
+         * @param in segment_size - payload of each datagram
+         *
+         * @return number of bytes sent, -1 on failure
+         */
+        int send_gso(const net_endpoint &ep, uint8_t *data, size_t data_len, uint16_t segment_size) noexcept
+        {
+            return udp_send_gso(fd_, &ep, data, data_len, segment_size);
+        }
+
+        /**
+         * @brief - send to the connected endpoint as segment_size datagrams
+         *
+         * @return number of bytes sent, -1 on failure
+         */
+        int send_gso(uint8_t *data, size_t data_len, uint16_t segment_size) noexcept
+        {
+            return udp_send_gso(fd_, nullptr, data, data_len, segment_size);
+        }
+
+        /**
+         * @brief - coalesce received datagrams of a flow, read them with recv_gro
+         *
+         * @return 0 on success -1 if not supported
+         */
+        int enable_gro() noexcept
+        {
+            return udp_enable_gro(fd_);
+        }
+
+        /**
+         * @brief - receive a train of datagrams coalesced by UDP_GRO
+         *
+         * @param inout msg - buffer, sender filled in binary form
+         * @param out segment_size - size of each datagram in the train
+         * @param in flags - MSG_DONTWAIT to not block
+         *
+         * @return number of bytes received, 0 if nothing is queued, -1 on failure
+         */
+        int recv_gro(udp_msg &msg, uint16_t &segment_size, int flags = MSG_DONTWAIT) noexcept
+        {
+            return udp_recv_gro(fd_, msg, segment_size, flags);
+        }
     private:
         int fd_;
 };
@@ -221,6 +982,118 @@ class udp_client {
          */
         int recv_msg(std::string &addr,
                      int &port, uint8_t *data, size_t data_len) noexcept;
+
+        /**
+         * @brief - send datagrams in one system call per udp_batch_max of them
+         *
+         * @param inout msgs - datagrams with their target in binary form
+         * @param in n_msgs - number of datagrams
+         *
+         * @return number of datagrams sent, -1 on failure
+         */
+        int send_batch(udp_msg *msgs, int n_msgs) noexcept
+        {
+            return udp_send_batch(fd_, msgs, n_msgs);
+        }
+
+        /**
+         * @brief - receive up to udp_batch_max datagrams in one system call
+         *
+         * @param inout msgs - datagrams, sender filled in binary form
+         * @param in n_msgs - number of datagrams
+         * @param in flags - MSG_DONTWAIT to not block
+         *
+         * @return number of datagrams received, 0 if none is queued, -1 on failure
+         */
+        int recv_batch(udp_msg *msgs, int n_msgs, int flags = MSG_DONTWAIT) noexcept
+        {
+            return udp_recv_batch(fd_, msgs, n_msgs, flags);
+        }
+
+        /**
+         * @brief - send to an endpoint resolved beforehand, no parsing on the send path
+         *
+         * @param in ep - target, of the same family as the socket
+         * @param in data - data to send
+         * @param in data_len - length of data
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(const net_endpoint &ep, uint8_t *data, size_t data_len) noexcept
+        {
+            return net_endpoint_send(fd_, ep, data, data_len);
+        }
+
+        /**
+         * @brief - connect to an endpoint, the kernel then skips the route lookup per send
+         *
+         * @param in ep - peer, only datagrams from it are received afterwards
+         *
+         * @return 0 on success -1 on failure
+         */
+        int connect_to(const net_endpoint &ep) noexcept
+        {
+            return net_endpoint_connect(fd_, ep);
+        }
+
+        /**
+         * @brief - send to the connected endpoint
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(uint8_t *data, size_t data_len) noexcept
+        {
+            return send(fd_, data, data_len, 0);
+        }
+
+        /**
+         * @brief - send a buffer as segment_size datagrams, 64 KB per system call with UDP_SEGMENT
+         *
+         * @param in ep - target
+         * @param in data - data to send
+         * @param in data_len - length of data
+         * @param in segment_size - payload of each datagram
+         *
+         * @return number of bytes sent, -1 on failure
+         */
+        int send_gso(const net_endpoint &ep, uint8_t *data, size_t data_len, uint16_t segment_size) noexcept
+        {
+            return udp_send_gso(fd_, &ep, data, data_len, segment_size);
+        }
+
+        /**
+         * @brief - send to the connected endpoint as segment_size datagrams
+         *
+         * @return number of bytes sent, -1 on failure
+         */
+        int send_gso(uint8_t *data, size_t data_len, uint16_t segment_size) noexcept
+        {
+            return udp_send_gso(fd_, nullptr, data, data_len, segment_size);
+        }
+
+        /**
+         * @brief - coalesce received datagrams of a flow, read them with recv_gro
+         *
+         * @return 0 on success -1 if not supported
+         */
+        int enable_gro() noexcept
+        {
+            return udp_enable_gro(fd_);
+        }
+
+        /**
+         * @brief - receive a train of datagrams coalesced by UDP_GRO
+         *
+         * @param inout msg - buffer, sender filled in binary form
+         * @param out segment_size - size of each datagram in the train
+         * @param in flags - MSG_DONTWAIT to not block
+         *
+         * @return number of bytes received, 0 if nothing is queued, -1 on failure
+         */
+        int recv_gro(udp_msg &msg, uint16_t &segment_size, int flags = MSG_DONTWAIT) noexcept
+        {
+            return udp_recv_gro(fd_, msg, segment_size, flags);
+        }
     private:
         int fd_;
 };
@@ -291,6 +1164,32 @@ class unix_tcp_conn {
 
         int send_msg(uint8_t *data, size_t data_len) noexcept;
         int recv_msg(uint8_t *data, size_t data_len) noexcept;
+
+        /**
+         * @brief - send header, payload and trailer from separate buffers without copying
+         *
+         * @param inout iov - buffers, advanced past the bytes sent
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes sent, less than the total if the socket would block, -1 on failure
+         */
+        int sendv(struct iovec *iov, int iovcnt) noexcept
+        {
+            return socket_sendv(fd_, iov, iovcnt);
+        }
+
+        /**
+         * @brief - receive into separate buffers with one system call
+         *
+         * @param in iov - buffers, filled in order
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes received, 0 on peer close, -1 on failure
+         */
+        int recvv(struct iovec *iov, int iovcnt) noexcept
+        {
+            return socket_recvv(fd_, iov, iovcnt);
+        }
     private:
         int fd_;
         std::string path_;
@@ -317,6 +1216,32 @@ class unix_tcp_client {
         int get_socket() const noexcept;
         int send_msg(uint8_t *data, size_t data_len) noexcept;
         int recv_msg(uint8_t *data, size_t data_len) noexcept;
+
+        /**
+         * @brief - send header, payload and trailer from separate buffers without copying
+         *
+         * @param inout iov - buffers, advanced past the bytes sent
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes sent, less than the total if the socket would block, -1 on failure
+         */
+        int sendv(struct iovec *iov, int iovcnt) noexcept
+        {
+            return socket_sendv(fd_, iov, iovcnt);
+        }
+
+        /**
+         * @brief - receive into separate buffers with one system call
+         *
+         * @param in iov - buffers, filled in order
+         * @param in iovcnt - number of buffers
+         *
+         * @return number of bytes received, 0 on peer close, -1 on failure
+         */
+        int recvv(struct iovec *iov, int iovcnt) noexcept
+        {
+            return socket_recvv(fd_, iov, iovcnt);
+        }
     private:
         int fd_;
         std::string path_;
@@ -330,6 +1255,42 @@ struct unix_udp_server {
         int get_socket() const noexcept;
         int send_msg(const std::string path, uint8_t *data, size_t data_len) noexcept;
         int recv_msg(std::string &path, uint8_t *data, size_t data_len) noexcept;
+
+        /**
+         * @brief - send to an endpoint resolved beforehand, no parsing on the send path
+         *
+         * @param in ep - target, of the same family as the socket
+         * @param in data - data to send
+         * @param in data_len - length of data
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(const net_endpoint &ep, uint8_t *data, size_t data_len) noexcept
+        {
+            return net_endpoint_send(fd_, ep, data, data_len);
+        }
+
+        /**
+         * @brief - connect to an endpoint, the kernel then skips the route lookup per send
+         *
+         * @param in ep - peer, only datagrams from it are received afterwards
+         *
+         * @return 0 on success -1 on failure
+         */
+        int connect_to(const net_endpoint &ep) noexcept
+        {
+            return net_endpoint_connect(fd_, ep);
+        }
+
+        /**
+         * @brief - send to the connected endpoint
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(uint8_t *data, size_t data_len) noexcept
+        {
+            return send(fd_, data, data_len, 0);
+        }
     private:
         int fd_;
         std::string path_;
@@ -343,6 +1304,42 @@ struct unix_udp_client {
         int get_socket() const noexcept;
         int send_msg(const std::string path, uint8_t *data, size_t data_len) noexcept;
         int recv_msg(std::string &path, uint8_t *data, size_t data_len) noexcept;
+
+        /**
+         * @brief - send to an endpoint resolved beforehand, no parsing on the send path
+         *
+         * @param in ep - target, of the same family as the socket
+         * @param in data - data to send
+         * @param in data_len - length of data
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(const net_endpoint &ep, uint8_t *data, size_t data_len) noexcept
+        {
+            return net_endpoint_send(fd_, ep, data, data_len);
+        }
+
+        /**
+         * @brief - connect to an endpoint, the kernel then skips the route lookup per send
+         *
+         * @param in ep - peer, only datagrams from it are received afterwards
+         *
+         * @return 0 on success -1 on failure
+         */
+        int connect_to(const net_endpoint &ep) noexcept
+        {
+            return net_endpoint_connect(fd_, ep);
+        }
+
+        /**
+         * @brief - send to the connected endpoint
+         *
+         * @return number of bytes on success -1 on failure
+         */
+        int send_msg(uint8_t *data, size_t data_len) noexcept
+        {
+            return send(fd_, data, data_len, 0);
+        }
     private:
         int fd_;
         std::string path_;
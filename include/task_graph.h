@@ -0,0 +1,210 @@
+/**
+ * @brief - implements dependency graph of jobs run on a thread_pool
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_TASK_GRAPH_H__
+#define __AUTO_LIB_TASK_GRAPH_H__
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <thread_pool.h>
+
+namespace auto_os::lib {
+
+/**
+ * @brief - implements task_graph node
+ */
+struct task_graph_node {
+    job_fn fn_;
+    // tasks that wait for this one
+    std::vector<int> succ_;
+    int n_deps_ = 0;
+    // dependencies not yet finished in the current run
+    std::atomic<int> pending_{0};
+    // set when a dependency threw or was skipped in the current run
+    std::atomic<bool> skip_{false};
+};
+
+/**
+ * @brief - implements task graph
+ *
+ * @details - a task is queued on the pool as soon as all of its dependencies
+ *            have finished. if a task throws, the tasks depending on it directly
+ *            or through other tasks are skipped, the independent ones still run,
+ *            and run() rethrows the exception
+ */
+class task_graph {
+    public:
+        explicit task_graph(thread_pool *pool) : pool_(pool) { }
+        ~task_graph() { }
+
+        task_graph(const task_graph &) = delete;
+        task_graph &operator=(const task_graph &) = delete;
+
+        /**
+         * @brief - add a task
+         *
+         * @param in fn - job to run
+         *
+         * @return id of the task
+         */
+        int add_task(job_fn fn);
+
+        /**
+         * @brief - make a task wait for another one to finish
+         *
+         * @param in before - id of the task to finish first
+         * @param in after - id of the dependent task
+         *
+         * @return 0 on success -1 on invalid ids
+         */
+        int add_dependency(int before, int after);
+
+        /**
+         * @brief - run all tasks and wait for them
+         *
+         * @return 0 on success -1 if the dependencies form a cycle
+         */
+        int run();
+
+        size_t size() const { return nodes_.size(); }
+
+    private:
+        struct run_state : task_latch {
+            std::atomic<size_t> remaining_{0};
+            std::mutex ex_lock_;
+            std::exception_ptr ex_;
+        };
+
+        thread_pool *pool_;
+        std::deque<task_graph_node> nodes_;
+
+        bool has_cycle_() const;
+        void schedule_(std::shared_ptr<run_state> state, int id);
+};
+
+inline int task_graph::add_task(job_fn fn)
+{
+    nodes_.emplace_back();
+    nodes_.back().fn_ = std::move(fn);
+
+    return nodes_.size() - 1;
+}
+
+inline int task_graph::add_dependency(int before, int after)
+{
+    if ((before < 0) || (after < 0) || (before == after) ||
+        (before >= (int)nodes_.size()) || (after >= (int)nodes_.size())) {
+        return -1;
+    }
+
+    nodes_[before].succ_.push_back(after);
+    nodes_[after].n_deps_ ++;
+
+    return 0;
+}
+
+inline bool task_graph::has_cycle_() const
+{
+    std::vector<int> deps(nodes_.size());
+    std::vector<int> ready;
+    size_t visited = 0;
+
+    for (size_t i = 0; i < nodes_.size(); i ++) {
+        deps[i] = nodes_[i].n_deps_;
+        if (deps[i] == 0) {
+            ready.push_back(i);
+        }
+    }
+
+    while (!ready.empty()) {
+        int id = ready.back();
+
+        ready.pop_back();
+        visited ++;
+
+        for (auto succ : nodes_[id].succ_) {
+            if (-- deps[succ] == 0) {
+                ready.push_back(succ);
+            }
+        }
+    }
+
+    return visited != nodes_.size();
+}
+
+inline void task_graph::schedule_(std::shared_ptr<run_state> state, int id)
+{
+    pool_->queue_work([this, state, id]() {
+        task_graph_node &node = nodes_[id];
+        bool skip = node.skip_.load(std::memory_order_relaxed);
+
+        if (!skip) {
+            try {
+                node.fn_();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->ex_lock_);
+
+                if (!state->ex_) {
+                    state->ex_ = std::current_exception();
+                }
+                skip = true;
+            }
+        }
+
+        // only the tasks downstream of a failure are skipped, other branches still run
+        for (auto succ : node.succ_) {
+            if (skip) {
+                nodes_[succ].skip_.store(true, std::memory_order_relaxed);
+            }
+            if (nodes_[succ].pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                schedule_(state, succ);
+            }
+        }
+
+        // the graph may be gone once the last task is accounted for
+        if (state->remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            state->set();
+        }
+    });
+}
+
+inline int task_graph::run()
+{
+    auto state = std::make_shared<run_state>();
+
+    if (has_cycle_()) {
+        return -1;
+    }
+
+    if (nodes_.empty()) {
+        return 0;
+    }
+
+    for (auto &it : nodes_) {
+        it.pending_.store(it.n_deps_, std::memory_order_relaxed);
+        it.skip_.store(false, std::memory_order_relaxed);
+    }
+    state->remaining_.store(nodes_.size(), std::memory_order_relaxed);
+
+    for (size_t i = 0; i < nodes_.size(); i ++) {
+        if (nodes_[i].n_deps_ == 0) {
+            schedule_(state, i);
+        }
+    }
+
+    pool_->wait(*state);
+
+    if (state->ex_) {
+        std::rethrow_exception(state->ex_);
+    }
+
+    return 0;
+}
+
+}
+
+#endif
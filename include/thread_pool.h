@@ -0,0 +1,739 @@
+/**
+ * @brief - implements work stealing thread pool
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_THREAD_POOL_H__
+#define __AUTO_LIB_THREAD_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <exception>
+#include <type_traits>
+#include <thread>
+#include <vector>
+#include <inline_fn.h>
+#include <work_steal_deque.h>
+
+namespace auto_os::lib {
+
+// header only like the event loop, kept apart from the thread_pool symbols still
+// exported by the prebuilt libauto_lib.so
+inline namespace v2 {
+
+// job callback
+typedef inline_fn<void(void)> job_fn;
+
+// rounds an idle worker looks for work before it parks
+static constexpr int thread_pool_spin_count = 64;
+
+// finished jobs kept per thread for reuse
+static constexpr size_t thread_pool_job_cache_size = 256;
+
+// jobs moved at once between a thread's cache and the shared depot
+static constexpr size_t thread_pool_job_batch = 64;
+
+// finished jobs kept in the shared depot, the rest are freed
+static constexpr size_t thread_pool_job_depot_size = 4096;
+
+/**
+ * @brief - implements per thread cache of job storage
+ */
+struct thread_pool_job_cache {
+    std::vector<job_fn *> free_;
+
+    ~thread_pool_job_cache()
+    {
+        for (auto it : free_) {
+            delete it;
+        }
+    }
+};
+
+/**
+ * @brief - implements job storage shared by all threads
+ *
+ * @details - jobs are freed by the workers but mostly allocated by threads outside
+ *            of the pool, a full worker cache hands a batch over here and an empty
+ *            producer cache takes one back, so job storage is reused in steady state
+ */
+struct thread_pool_job_depot {
+    std::mutex lock_;
+    std::vector<job_fn *> free_;
+};
+
+/**
+ * @brief - implements thread_worker statistics
+ */
+struct thread_worker_stats {
+    // jobs waiting in the deque of the worker
+    size_t queue_depth;
+    // jobs run by the worker
+    uint64_t executed;
+    // jobs the worker took from the deque of another worker
+    uint64_t steals;
+    // times the worker went to sleep for lack of work
+    uint64_t parks;
+};
+
+/**
+ * @brief - implements thread_pool statistics
+ */
+struct thread_pool_stats {
+    // jobs waiting in the injection queue
+    size_t inject_depth;
+    std::vector<thread_worker_stats> workers_;
+};
+
+class thread_pool;
+
+/**
+ * @brief - implements completion latch of a job submitted to the pool
+ */
+struct task_latch {
+    std::atomic<bool> done_{false};
+    std::mutex lock_;
+    std::condition_variable cv_;
+
+    void set()
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+
+            done_.store(true, std::memory_order_release);
+        }
+        cv_.notify_all();
+    }
+};
+
+/**
+ * @brief - implements result of a job submitted to the pool
+ */
+template <typename T>
+struct task_state : task_latch {
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> val_;
+    std::exception_ptr ex_;
+};
+
+/**
+ * @brief - implements handle to the result of thread_pool::submit
+ *
+ * @details - waiting from a worker of the same pool runs other queued jobs
+ *            meanwhile, so nested submits cannot deadlock the pool
+ */
+template <typename T>
+class task_future {
+    public:
+        explicit task_future() = default;
+
+        bool valid() const { return state_ != nullptr; }
+        bool ready() const { return state_ && state_->done_.load(std::memory_order_acquire); }
+
+        /**
+         * @brief - wait until the job has run
+         */
+        void wait() const;
+
+        /**
+         * @brief - wait and return the result, rethrows the exception of the job
+         */
+        T get();
+
+    private:
+        friend class thread_pool;
+
+        explicit task_future(thread_pool *pool, std::shared_ptr<task_state<T>> state) :
+                             pool_(pool), state_(std::move(state)) { }
+
+        thread_pool *pool_ = nullptr;
+        std::shared_ptr<task_state<T>> state_;
+};
+
+/*
+ * @brief - a process that is instantiated by the Parallel
+ */
+class thread_worker {
+    public:
+        explicit thread_worker(thread_pool *pool) : pool_(pool) { }
+        ~thread_worker() { }
+
+        thread_worker_stats get_stats() const
+        {
+            return {
+                deque_.size(),
+                executed_.load(std::memory_order_relaxed),
+                steals_.load(std::memory_order_relaxed),
+                parks_.load(std::memory_order_relaxed),
+            };
+        }
+
+    private:
+        friend class thread_pool;
+
+        thread_pool *pool_;
+        std::thread proc_;
+        // jobs queued by the worker itself, stolen by the others when idle
+        work_steal_deque<job_fn> deque_;
+        std::atomic<uint64_t> executed_{0};
+        std::atomic<uint64_t> steals_{0};
+        std::atomic<uint64_t> parks_{0};
+        // state of the victim selection
+        uint32_t rand_ = 0;
+};
+
+/**
+ * @brief - implements threadpool design pattern
+ *
+ * @details - jobs queued from outside the pool go to a shared injection queue,
+ *            jobs queued from a worker go to the bottom of its own deque. an idle
+ *            worker steals from the top of the others, spins for a while and then
+ *            parks until new work is queued
+ */
+class thread_pool {
+    public:
+        explicit thread_pool() : thread_pool(std::thread::hardware_concurrency()) { }
+
+        /**
+         * @brief - create thread pool
+         *
+         * @param in n_threads - number of workers, at least one is created
+         */
+        explicit thread_pool(uint32_t n_threads);
+        ~thread_pool();
+
+        thread_pool(const thread_pool &) = delete;
+        thread_pool &operator=(const thread_pool &) = delete;
+
+        void queue_work(job_fn job);
+
+        /**
+         * @brief - queue a job and return a handle to its result
+         *
+         * @param in fn - callable without arguments
+         *
+         * @return future of the value returned by fn
+         */
+        template <typename F>
+        auto submit(F &&fn) -> task_future<std::invoke_result_t<std::decay_t<F>>>;
+
+        /**
+         * @brief - run fn over [begin, end) in chunks, returns once all chunks are done
+         *
+         * @param in begin - first index
+         * @param in end - one past the last index
+         * @param in chunk - indices per call of fn, 0 to split evenly across the workers
+         * @param in fn - called with the [begin, end) of one chunk
+         *
+         * @details - the calling thread runs chunks too. the first exception thrown
+         *            by fn is rethrown once every chunk has finished
+         */
+        void parallel_for(size_t begin, size_t end, size_t chunk,
+                          const std::function<void(size_t, size_t)> &fn);
+
+        /**
+         * @brief - run one queued job on the calling thread
+         *
+         * @return true if a job was run false if there was none
+         */
+        bool run_one();
+
+        /**
+         * @brief - wait for the latch, workers of this pool run other jobs meanwhile
+         */
+        void wait(task_latch &latch);
+
+        /**
+         * @brief - run the queued jobs and stop the workers
+         */
+        void stopall();
+
+        /**
+         * @brief - returns queue depths and counters of the pool
+         */
+        thread_pool_stats get_stats() const;
+
+        int get_n_threads() const { return n_threads_; }
+
+    private:
+        std::vector<std::unique_ptr<thread_worker>> procs_;
+        int n_threads_;
+
+        std::mutex inject_lock_;
+        std::deque<job_fn *> inject_;
+        std::atomic<size_t> inject_size_{0};
+
+        // parking of idle workers, a token is handed out per wakeup
+        std::mutex park_lock_;
+        std::condition_variable park_cv_;
+        uint32_t wake_tokens_ = 0;
+        std::atomic<uint32_t> sleepers_{0};
+        std::atomic<bool> stop_{false};
+
+        static thread_worker *&current_();
+        static thread_pool_job_cache &job_cache_();
+        static thread_pool_job_depot &job_depot_();
+        static job_fn *alloc_job_(job_fn &&job);
+        static void free_job_(job_fn *job);
+        void run_(thread_worker *w);
+        void run_job_(thread_worker *w, job_fn *job);
+        job_fn *find_work_(thread_worker *w);
+        bool has_work_() const;
+        void park_(thread_worker *w);
+        void notify_();
+};
+
+inline thread_pool::thread_pool(uint32_t n_threads)
+{
+    n_threads_ = (n_threads > 0) ? n_threads : 1;
+
+    // every worker exists before any of them looks for a victim
+    for (int i = 0; i < n_threads_; i ++) {
+        procs_.push_back(std::make_unique<thread_worker>(this));
+        procs_.back()->rand_ = i + 1;
+    }
+
+    for (auto &it : procs_) {
+        thread_worker *w = it.get();
+
+        w->proc_ = std::thread(&thread_pool::run_, this, w);
+    }
+}
+
+inline thread_pool::~thread_pool()
+{
+    job_fn *job;
+
+    stopall();
+
+    // jobs queued after stopall are never run
+    for (auto &it : procs_) {
+        while ((job = it->deque_.pop()) != nullptr) {
+            delete job;
+        }
+    }
+    for (auto &it : inject_) {
+        delete it;
+    }
+}
+
+inline thread_worker *&thread_pool::current_()
+{
+    static thread_local thread_worker *w = nullptr;
+
+    return w;
+}
+
+inline thread_pool_job_cache &thread_pool::job_cache_()
+{
+    static thread_local thread_pool_job_cache cache;
+
+    return cache;
+}
+
+inline thread_pool_job_depot &thread_pool::job_depot_()
+{
+    // never destroyed, workers of a static pool may still free jobs during exit
+    static thread_pool_job_depot *depot = new thread_pool_job_depot();
+
+    return *depot;
+}
+
+inline job_fn *thread_pool::alloc_job_(job_fn &&job)
+{
+    thread_pool_job_cache &cache = job_cache_();
+    job_fn *j;
+
+    if (cache.free_.empty()) {
+        thread_pool_job_depot &depot = job_depot_();
+        std::lock_guard<std::mutex> lock(depot.lock_);
+        size_t n = std::min(depot.free_.size(), thread_pool_job_batch);
+
+        cache.free_.insert(cache.free_.end(), depot.free_.end() - n, depot.free_.end());
+        depot.free_.resize(depot.free_.size() - n);
+    }
+
+    if (cache.free_.empty()) {
+        return new job_fn(std::move(job));
+    }
+
+    j = cache.free_.back();
+    cache.free_.pop_back();
+    *j = std::move(job);
+    return j;
+}
+
+inline void thread_pool::free_job_(job_fn *job)
+{
+    thread_pool_job_cache &cache = job_cache_();
+
+    *job = nullptr;
+    cache.free_.push_back(job);
+    if (cache.free_.size() <= thread_pool_job_cache_size) {
+        return;
+    }
+
+    // the cache of a worker fills up when jobs come from outside the pool
+    thread_pool_job_depot &depot = job_depot_();
+    std::lock_guard<std::mutex> lock(depot.lock_);
+
+    for (size_t i = 0; i < thread_pool_job_batch; i ++) {
+        job = cache.free_.back();
+        cache.free_.pop_back();
+        if (depot.free_.size() < thread_pool_job_depot_size) {
+            depot.free_.push_back(job);
+        } else {
+            delete job;
+        }
+    }
+}
+
+inline void thread_pool::queue_work(job_fn job)
+{
+    thread_worker *w = current_();
+    job_fn *j = alloc_job_(std::move(job));
+
+    if (w && (w->pool_ == this)) {
+        w->deque_.push(j);
+    } else {
+        std::lock_guard<std::mutex> lock(inject_lock_);
+
+        inject_.push_back(j);
+        inject_size_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    notify_();
+}
+
+inline void thread_pool::notify_()
+{
+    // pairs with the fence in park_, either the sleeper sees the job or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(park_lock_);
+
+    if (wake_tokens_ < sleepers_.load(std::memory_order_relaxed)) {
+        wake_tokens_ ++;
+        park_cv_.notify_one();
+    }
+}
+
+inline bool thread_pool::has_work_() const
+{
+    if (inject_size_.load(std::memory_order_relaxed) > 0) {
+        return true;
+    }
+
+    for (auto &it : procs_) {
+        if (it->deque_.size() > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline job_fn *thread_pool::find_work_(thread_worker *w)
+{
+    static thread_local uint32_t rand = 1;
+    uint32_t *state = w ? &w->rand_ : &rand;
+    job_fn *job;
+    uint32_t start;
+
+    // threads outside of the pool only take from the shared queues
+    if (w) {
+        job = w->deque_.pop();
+        if (job) {
+            return job;
+        }
+    }
+
+    if (inject_size_.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(inject_lock_);
+
+        if (!inject_.empty()) {
+            job = inject_.front();
+            inject_.pop_front();
+            inject_size_.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    // xorshift, so that idle workers do not all hit the same victim
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    start = *state % n_threads_;
+
+    for (int i = 0; i < n_threads_; i ++) {
+        thread_worker *victim = procs_[(start + i) % n_threads_].get();
+
+        if (victim == w) {
+            continue;
+        }
+
+        job = victim->deque_.steal();
+        if (job) {
+            if (w) {
+                w->steals_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+inline void thread_pool::park_(thread_worker *w)
+{
+    std::unique_lock<std::mutex> lock(park_lock_);
+
+    sleepers_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (!stop_ && !has_work_()) {
+        w->parks_.fetch_add(1, std::memory_order_relaxed);
+        park_cv_.wait(lock, [this]() { return (wake_tokens_ > 0) || stop_; });
+        if (wake_tokens_ > 0) {
+            wake_tokens_ --;
+        }
+    }
+
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void thread_pool::run_(thread_worker *w)
+{
+    job_fn *job;
+    int i;
+
+    current_() = w;
+
+    while (1) {
+        job = find_work_(w);
+
+        for (i = 0; !job && (i < thread_pool_spin_count); i ++) {
+            if (i < thread_pool_spin_count / 2) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            } else {
+                std::this_thread::yield();
+            }
+            job = find_work_(w);
+        }
+
+        if (job) {
+            run_job_(w, job);
+            continue;
+        }
+
+        // the queues are drained before the worker exits
+        if (stop_.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        park_(w);
+    }
+
+    current_() = nullptr;
+}
+
+inline void thread_pool::run_job_(thread_worker *w, job_fn *job)
+{
+    (*job)();
+    free_job_(job);
+    if (w) {
+        w->executed_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline bool thread_pool::run_one()
+{
+    thread_worker *w = current_();
+    job_fn *job;
+
+    if (w && (w->pool_ != this)) {
+        w = nullptr;
+    }
+
+    job = find_work_(w);
+    if (!job) {
+        return false;
+    }
+
+    run_job_(w, job);
+    return true;
+}
+
+inline void thread_pool::wait(task_latch &latch)
+{
+    thread_worker *w = current_();
+
+    // a blocked worker could be the one the latch waits for
+    if (w && (w->pool_ == this)) {
+        while (!latch.done_.load(std::memory_order_acquire)) {
+            if (!run_one()) {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(latch.lock_);
+
+    latch.cv_.wait(lock, [&latch]() { return latch.done_.load(std::memory_order_acquire); });
+}
+
+template <typename F>
+auto thread_pool::submit(F &&fn) -> task_future<std::invoke_result_t<std::decay_t<F>>>
+{
+    typedef std::invoke_result_t<std::decay_t<F>> R;
+    auto state = std::make_shared<task_state<R>>();
+
+    queue_work([state, fn = std::forward<F>(fn)]() mutable {
+        try {
+            if constexpr (std::is_void_v<R>) {
+                fn();
+            } else {
+                state->val_.emplace(fn());
+            }
+        } catch (...) {
+            state->ex_ = std::current_exception();
+        }
+        state->set();
+    });
+
+    return task_future<R>(this, state);
+}
+
+inline void thread_pool::parallel_for(size_t begin, size_t end, size_t chunk,
+                                      const std::function<void(size_t, size_t)> &fn)
+{
+    struct for_state : task_latch {
+        std::function<void(size_t, size_t)> fn_;
+        size_t begin_;
+        size_t end_;
+        size_t chunk_;
+        size_t n_chunks_;
+        std::atomic<size_t> next_{0};
+        std::atomic<size_t> finished_{0};
+        std::mutex ex_lock_;
+        std::exception_ptr ex_;
+
+        // claim chunks until none are left, helpers queued late find nothing to do
+        void run()
+        {
+            size_t idx;
+
+            while ((idx = next_.fetch_add(1, std::memory_order_relaxed)) < n_chunks_) {
+                size_t b = begin_ + idx * chunk_;
+                size_t e = std::min(b + chunk_, end_);
+
+                try {
+                    fn_(b, e);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(ex_lock_);
+
+                    if (!ex_) {
+                        ex_ = std::current_exception();
+                    }
+                }
+
+                if (finished_.fetch_add(1, std::memory_order_acq_rel) + 1 == n_chunks_) {
+                    set();
+                }
+            }
+        }
+    };
+    auto state = std::make_shared<for_state>();
+    size_t n_helpers;
+
+    if (begin >= end) {
+        return;
+    }
+
+    if (chunk == 0) {
+        chunk = (end - begin + n_threads_ * 4 - 1) / (n_threads_ * 4);
+    }
+
+    state->fn_ = fn;
+    state->begin_ = begin;
+    state->end_ = end;
+    state->chunk_ = chunk;
+    state->n_chunks_ = (end - begin + chunk - 1) / chunk;
+
+    n_helpers = std::min<size_t>(state->n_chunks_ - 1, n_threads_);
+    for (size_t i = 0; i < n_helpers; i ++) {
+        queue_work([state]() { state->run(); });
+    }
+
+    state->run();
+    wait(*state);
+
+    if (state->ex_) {
+        std::rethrow_exception(state->ex_);
+    }
+}
+
+inline void thread_pool::stopall()
+{
+    {
+        std::lock_guard<std::mutex> lock(park_lock_);
+
+        stop_.store(true, std::memory_order_release);
+        park_cv_.notify_all();
+    }
+
+    for (auto &it : procs_) {
+        if (it->proc_.joinable()) {
+            it->proc_.join();
+        }
+    }
+}
+
+inline thread_pool_stats thread_pool::get_stats() const
+{
+    thread_pool_stats stats;
+
+    stats.inject_depth = inject_size_.load(std::memory_order_relaxed);
+    for (auto &it : procs_) {
+        stats.workers_.push_back(it->get_stats());
+    }
+
+    return stats;
+}
+
+template <typename T>
+inline void task_future<T>::wait() const
+{
+    pool_->wait(*state_);
+}
+
+template <typename T>
+inline T task_future<T>::get()
+{
+    wait();
+
+    if (state_->ex_) {
+        std::rethrow_exception(state_->ex_);
+    }
+
+    if constexpr (!std::is_void_v<T>) {
+        return std::move(*state_->val_);
+    }
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,514 @@
+/**
+ * @brief - implements hierarchical timing wheel
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_TIMER_WHEEL_H__
+#define __AUTO_LIB_TIMER_WHEEL_H__
+
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <inline_fn.h>
+
+namespace auto_os::lib {
+
+// number of slots per level as power of 2
+static constexpr uint32_t timer_wheel_slot_bits = 8;
+static constexpr uint32_t timer_wheel_slots = 1 << timer_wheel_slot_bits;
+static constexpr uint32_t timer_wheel_slot_mask = timer_wheel_slots - 1;
+
+// four levels cover 2^32 ticks, longer timeouts are clamped
+static constexpr uint32_t timer_wheel_levels = 4;
+static constexpr uint64_t timer_wheel_max_ticks = (1ULL << (timer_wheel_slot_bits * timer_wheel_levels)) - 1;
+
+// invalid node index
+static constexpr uint32_t timer_wheel_nil = UINT32_MAX;
+
+/**
+ * @brief - state of a timer_wheel node
+ */
+enum class timer_wheel_node_state {
+    // on the free list
+    free,
+    // linked into a slot
+    pending,
+    // callback is running
+    running,
+    // cancelled while the callback is running, freed once it returns
+    cancelled,
+};
+
+/**
+ * @brief - implements timer_wheel node, linked into one slot of one level
+ */
+struct timer_wheel_node {
+    uint32_t next_ = timer_wheel_nil;
+    uint32_t prev_ = timer_wheel_nil;
+    uint64_t expires_ = 0;
+    uint64_t interval_ = 0;
+    uint8_t level_ = 0;
+    uint8_t slot_ = 0;
+    // set when rearmed from its own callback
+    bool rearmed_ = false;
+    timer_wheel_node_state state_ = timer_wheel_node_state::free;
+    // bumped every time the node is freed, stale handles no longer match
+    uint32_t gen_ = 0;
+    // owner defined deadline after the expiry and its misses, cleared when freed
+    uint64_t deadline_ = 0;
+    uint64_t deadline_misses_ = 0;
+    inline_fn<void(void)> fn_;
+};
+
+/**
+ * @brief - handle of an armed timer
+ */
+struct timer_handle {
+    uint32_t id_ = timer_wheel_nil;
+    uint32_t gen_ = 0;
+
+    /**
+     * @brief - returns false if the timer could not be created
+     */
+    bool valid() const { return id_ != timer_wheel_nil; }
+};
+
+/**
+ * @brief - implements hierarchical timing wheel
+ *
+ * @details - time is counted in ticks, the owner advances the wheel to the
+ *            current tick. arm and cancel are O(1), expiry cascades timers of
+ *            the higher levels into level 0 once every 256 ticks.
+ */
+/**
+ * @brief - called in place of each timer callback, it must call node.fn_
+ *
+ * @details - expires is the tick the timer was due at
+ */
+typedef inline_fn<void(uint64_t expires, timer_wheel_node &node)> timer_wheel_hook;
+
+class timer_wheel {
+    public:
+        explicit timer_wheel() = default;
+        ~timer_wheel() = default;
+
+        timer_wheel(const timer_wheel &) = delete;
+        timer_wheel &operator=(const timer_wheel &) = delete;
+
+        /**
+         * @brief - arm a timer
+         *
+         * @param in expires - absolute tick at which the timer fires
+         * @param in interval - ticks between expiries of periodic timer, 0 for oneshot
+         * @param in fn - callback
+         *
+         * @return handle of the timer
+         */
+        timer_handle add(uint64_t expires, uint64_t interval, inline_fn<void(void)> fn);
+
+        /**
+         * @brief - cancel a timer
+         *
+         * @param in h - handle returned by add
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int cancel(timer_handle h);
+
+        /**
+         * @brief - move an armed timer to a new expiry, keeps the handle valid
+         *
+         * @param in h - handle returned by add
+         * @param in expires - absolute tick at which the timer fires
+         * @param in interval - ticks between expiries of periodic timer, 0 for oneshot
+         *
+         * @return 0 on success -1 if the timer is no longer armed
+         */
+        int rearm(timer_handle h, uint64_t expires, uint64_t interval);
+
+        /**
+         * @brief - returns node of an armed timer, nullptr if the handle is stale
+         *
+         * @param in h - handle returned by add
+         */
+        timer_wheel_node *find(timer_handle h)
+        {
+            return match_(h) ? &nodes_[h.id_] : nullptr;
+        }
+
+        /**
+         * @brief - cancel the first timer matching the predicate
+         *
+         * @param in pred - called with the callback of each armed timer
+         *
+         * @return 0 on success -1 if no timer matched
+         */
+        template <typename Pred>
+        int cancel_if(Pred pred)
+        {
+            for (uint32_t id = 0; id < nodes_.size(); id ++) {
+                // a running timer may be cancelling itself from its own callback
+                if (((nodes_[id].state_ == timer_wheel_node_state::pending) ||
+                     (nodes_[id].state_ == timer_wheel_node_state::running)) && pred(nodes_[id].fn_)) {
+                    return cancel_(id);
+                }
+            }
+            return -1;
+        }
+
+        /**
+         * @brief - run all timers that expire until the given tick
+         *
+         * @param in target - current tick
+         */
+        void advance(uint64_t target);
+
+        /**
+         * @brief - tick at which the wheel needs to be advanced next
+         *
+         * @details - either the next level 0 expiry or the next cascade
+         *
+         * @return tick, or UINT64_MAX if no timer is armed
+         */
+        uint64_t next_tick() const;
+
+        /**
+         * @brief - next tick the wheel processes
+         */
+        uint64_t now() const { return now_; }
+
+        /**
+         * @brief - number of armed timers
+         */
+        size_t size() const { return pending_; }
+
+        /**
+         * @brief - wrap every timer callback, used to measure them
+         *
+         * @param in hook - hook, nullptr to call the callbacks directly
+         */
+        void set_hook(timer_wheel_hook hook) { hook_ = std::move(hook); }
+
+    private:
+        // nodes never move, a running callback survives timers added from it
+        std::deque<timer_wheel_node> nodes_;
+        uint32_t free_ = timer_wheel_nil;
+        uint32_t slots_[timer_wheel_levels][timer_wheel_slots];
+        uint64_t occupied_[timer_wheel_slots / 64] = {};
+        bool slots_init_ = false;
+        uint64_t now_ = 0;
+        size_t pending_ = 0;
+        timer_wheel_hook hook_;
+
+        bool match_(timer_handle h) const;
+        int cancel_(uint32_t id);
+        void link_(uint32_t id);
+        void unlink_(uint32_t id);
+        void free_node_(uint32_t id);
+        void cascade_(uint32_t level);
+        void expire_(uint32_t slot);
+        int next_occupied_(uint32_t from) const;
+};
+
+inline timer_handle timer_wheel::add(uint64_t expires, uint64_t interval, inline_fn<void(void)> fn)
+{
+    uint32_t id;
+
+    if (!slots_init_) {
+        for (uint32_t l = 0; l < timer_wheel_levels; l ++) {
+            for (uint32_t s = 0; s < timer_wheel_slots; s ++) {
+                slots_[l][s] = timer_wheel_nil;
+            }
+        }
+        slots_init_ = true;
+    }
+
+    if (free_ != timer_wheel_nil) {
+        id = free_;
+        free_ = nodes_[id].next_;
+    } else {
+        id = nodes_.size();
+        nodes_.emplace_back();
+    }
+
+    timer_wheel_node &n = nodes_[id];
+
+    n.expires_ = expires;
+    n.interval_ = interval;
+    n.rearmed_ = false;
+    n.fn_ = std::move(fn);
+    n.state_ = timer_wheel_node_state::pending;
+
+    link_(id);
+    pending_ ++;
+
+    return timer_handle{id, n.gen_};
+}
+
+inline bool timer_wheel::match_(timer_handle h) const
+{
+    return (h.id_ < nodes_.size()) && (nodes_[h.id_].gen_ == h.gen_);
+}
+
+inline int timer_wheel::cancel(timer_handle h)
+{
+    if (!match_(h)) {
+        return -1;
+    }
+
+    return cancel_(h.id_);
+}
+
+inline int timer_wheel::rearm(timer_handle h, uint64_t expires, uint64_t interval)
+{
+    if (!match_(h)) {
+        return -1;
+    }
+
+    timer_wheel_node &n = nodes_[h.id_];
+
+    switch (n.state_) {
+        case timer_wheel_node_state::pending:
+            unlink_(h.id_);
+            n.expires_ = expires;
+            n.interval_ = interval;
+            link_(h.id_);
+        break;
+        case timer_wheel_node_state::running:
+            // linked by expire_ once the callback returns
+            n.expires_ = expires;
+            n.interval_ = interval;
+            n.rearmed_ = true;
+        break;
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+inline int timer_wheel::cancel_(uint32_t id)
+{
+    timer_wheel_node &n = nodes_[id];
+
+    switch (n.state_) {
+        case timer_wheel_node_state::pending:
+            unlink_(id);
+            pending_ --;
+            free_node_(id);
+        break;
+        case timer_wheel_node_state::running:
+            // the callback is still on the stack, expire_ frees the node. the handle
+            // goes stale now so that a rearm from the same callback cannot revive it
+            n.state_ = timer_wheel_node_state::cancelled;
+            n.rearmed_ = false;
+            n.gen_ ++;
+        break;
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+inline void timer_wheel::link_(uint32_t id)
+{
+    timer_wheel_node &n = nodes_[id];
+    uint64_t delta;
+    uint32_t level = 0;
+
+    if (n.expires_ < now_) {
+        n.expires_ = now_;
+    }
+    if (n.expires_ - now_ > timer_wheel_max_ticks) {
+        n.expires_ = now_ + timer_wheel_max_ticks;
+    }
+
+    delta = n.expires_ - now_;
+    while ((level < timer_wheel_levels - 1) &&
+           (delta >= (1ULL << (timer_wheel_slot_bits * (level + 1))))) {
+        level ++;
+    }
+
+    n.level_ = level;
+    n.slot_ = (n.expires_ >> (timer_wheel_slot_bits * level)) & timer_wheel_slot_mask;
+    n.prev_ = timer_wheel_nil;
+    n.next_ = slots_[level][n.slot_];
+    if (n.next_ != timer_wheel_nil) {
+        nodes_[n.next_].prev_ = id;
+    }
+    slots_[level][n.slot_] = id;
+
+    if (level == 0) {
+        occupied_[n.slot_ / 64] |= (1ULL << (n.slot_ % 64));
+    }
+}
+
+inline void timer_wheel::unlink_(uint32_t id)
+{
+    timer_wheel_node &n = nodes_[id];
+
+    if (n.prev_ != timer_wheel_nil) {
+        nodes_[n.prev_].next_ = n.next_;
+    } else {
+        slots_[n.level_][n.slot_] = n.next_;
+    }
+    if (n.next_ != timer_wheel_nil) {
+        nodes_[n.next_].prev_ = n.prev_;
+    }
+
+    if ((n.level_ == 0) && (slots_[0][n.slot_] == timer_wheel_nil)) {
+        occupied_[n.slot_ / 64] &= ~(1ULL << (n.slot_ % 64));
+    }
+}
+
+inline void timer_wheel::free_node_(uint32_t id)
+{
+    timer_wheel_node &n = nodes_[id];
+
+    n.state_ = timer_wheel_node_state::free;
+    n.gen_ ++;
+    n.deadline_ = 0;
+    n.deadline_misses_ = 0;
+    n.fn_ = nullptr;
+    n.prev_ = timer_wheel_nil;
+    n.next_ = free_;
+    free_ = id;
+}
+
+inline void timer_wheel::cascade_(uint32_t level)
+{
+    uint32_t slot = (now_ >> (timer_wheel_slot_bits * level)) & timer_wheel_slot_mask;
+    uint32_t id = slots_[level][slot];
+
+    slots_[level][slot] = timer_wheel_nil;
+
+    // timers of this slot now expire within the lower level's range
+    while (id != timer_wheel_nil) {
+        uint32_t next = nodes_[id].next_;
+
+        link_(id);
+        id = next;
+    }
+
+    if ((slot == 0) && (level < timer_wheel_levels - 1)) {
+        cascade_(level + 1);
+    }
+}
+
+inline void timer_wheel::expire_(uint32_t slot)
+{
+    uint32_t id = slots_[0][slot];
+
+    slots_[0][slot] = timer_wheel_nil;
+    occupied_[slot / 64] &= ~(1ULL << (slot % 64));
+
+    // every node of the slot is marked running before any callback may cancel it
+    for (uint32_t it = id; it != timer_wheel_nil; it = nodes_[it].next_) {
+        nodes_[it].state_ = timer_wheel_node_state::running;
+        pending_ --;
+    }
+
+    // callbacks see the next tick as now
+    now_ ++;
+
+    while (id != timer_wheel_nil) {
+        uint32_t next = nodes_[id].next_;
+
+        // an earlier callback of this slot may have cancelled it
+        if (nodes_[id].state_ == timer_wheel_node_state::running) {
+            if (hook_) {
+                hook_(now_ - 1, nodes_[id]);
+            } else {
+                nodes_[id].fn_();
+            }
+        }
+
+        timer_wheel_node &n = nodes_[id];
+        if ((n.state_ == timer_wheel_node_state::running) && (n.rearmed_ || (n.interval_ > 0))) {
+            if (!n.rearmed_) {
+                n.expires_ += n.interval_;
+            }
+            n.rearmed_ = false;
+            n.state_ = timer_wheel_node_state::pending;
+            link_(id);
+            pending_ ++;
+        } else {
+            free_node_(id);
+        }
+        id = next;
+    }
+}
+
+inline int timer_wheel::next_occupied_(uint32_t from) const
+{
+    for (uint32_t w = from / 64; w < timer_wheel_slots / 64; w ++) {
+        uint64_t bits = occupied_[w];
+
+        if (w == from / 64) {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits) {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+
+    return -1;
+}
+
+inline void timer_wheel::advance(uint64_t target)
+{
+    while (now_ <= target) {
+        uint32_t idx = now_ & timer_wheel_slot_mask;
+        int next;
+
+        if (pending_ == 0) {
+            now_ = target + 1;
+            break;
+        }
+
+        if (idx == 0) {
+            cascade_(1);
+        }
+
+        if (slots_[0][idx] != timer_wheel_nil) {
+            expire_(idx);
+            continue;
+        }
+
+        // nothing expires before the next occupied slot or the next cascade
+        next = next_occupied_(idx);
+        if (next < 0) {
+            next = timer_wheel_slots;
+        }
+        now_ = std::min(now_ + (next - idx), target + 1);
+    }
+}
+
+inline uint64_t timer_wheel::next_tick() const
+{
+    uint32_t idx = now_ & timer_wheel_slot_mask;
+    int next;
+
+    if (pending_ == 0) {
+        return UINT64_MAX;
+    }
+
+    // a cascade at this tick may move timers into level 0
+    if (idx == 0) {
+        return now_;
+    }
+
+    next = next_occupied_(idx);
+    if (next < 0) {
+        next = timer_wheel_slots;
+    }
+
+    return now_ + (next - idx);
+}
+
+}
+
+#endif
+
@@ -0,0 +1,157 @@
+/**
+ * @brief - implements Chase-Lev work stealing deque
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_WORK_STEAL_DEQUE_H__
+#define __AUTO_LIB_WORK_STEAL_DEQUE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace auto_os::lib {
+
+// initial number of slots of a work stealing deque
+static constexpr int64_t work_steal_deque_init_size = 256;
+
+/**
+ * @brief - implements work stealing deque of pointers
+ *
+ * @details - the owner thread pushes and pops at the bottom, any other thread
+ *            steals from the top. the ring doubles when full, retired rings are
+ *            freed with the deque since a thief may still be reading them
+ */
+template <typename T>
+class work_steal_deque {
+    public:
+        explicit work_steal_deque()
+        {
+            ring_.store(grow_(nullptr, 0, 0), std::memory_order_relaxed);
+        }
+
+        work_steal_deque(const work_steal_deque &) = delete;
+        work_steal_deque &operator=(const work_steal_deque &) = delete;
+
+        /**
+         * @brief - push at the bottom, owner thread only
+         */
+        void push(T *val)
+        {
+            int64_t b = bottom_.load(std::memory_order_relaxed);
+            int64_t t = top_.load(std::memory_order_acquire);
+            ring *r = ring_.load(std::memory_order_relaxed);
+
+            if (b - t > r->size_ - 1) {
+                r = grow_(r, t, b);
+                ring_.store(r, std::memory_order_release);
+            }
+
+            r->slots_[b & (r->size_ - 1)].store(val, std::memory_order_relaxed);
+            // publishes the slot and the job it points to to the thieves
+            bottom_.store(b + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief - pop from the bottom, owner thread only
+         *
+         * @return element, nullptr if empty
+         */
+        T *pop()
+        {
+            int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+            ring *r = ring_.load(std::memory_order_relaxed);
+            int64_t t;
+            T *val = nullptr;
+
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            t = top_.load(std::memory_order_relaxed);
+
+            if (t <= b) {
+                val = r->slots_[b & (r->size_ - 1)].load(std::memory_order_relaxed);
+                if (t == b) {
+                    // last element, race the thieves for it
+                    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                      std::memory_order_relaxed)) {
+                        val = nullptr;
+                    }
+                    bottom_.store(b + 1, std::memory_order_relaxed);
+                }
+            } else {
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+
+            return val;
+        }
+
+        /**
+         * @brief - steal from the top, safe from any thread
+         *
+         * @return element, nullptr if empty or another thread won the race
+         */
+        T *steal()
+        {
+            int64_t t = top_.load(std::memory_order_acquire);
+            int64_t b;
+            ring *r;
+            T *val;
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            b = bottom_.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+
+            r = ring_.load(std::memory_order_acquire);
+            val = r->slots_[t & (r->size_ - 1)].load(std::memory_order_relaxed);
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                return nullptr;
+            }
+
+            return val;
+        }
+
+        /**
+         * @brief - returns approximate number of elements
+         */
+        size_t size() const
+        {
+            int64_t b = bottom_.load(std::memory_order_relaxed);
+            int64_t t = top_.load(std::memory_order_relaxed);
+
+            return (b > t) ? (b - t) : 0;
+        }
+
+    private:
+        struct ring {
+            int64_t size_;
+            std::unique_ptr<std::atomic<T *>[]> slots_;
+        };
+
+        alignas(64) std::atomic<int64_t> top_{0};
+        alignas(64) std::atomic<int64_t> bottom_{0};
+        std::atomic<ring *> ring_;
+        std::vector<std::unique_ptr<ring>> rings_;
+
+        ring *grow_(ring *old, int64_t t, int64_t b)
+        {
+            auto r = std::make_unique<ring>();
+
+            r->size_ = old ? (old->size_ * 2) : work_steal_deque_init_size;
+            r->slots_ = std::make_unique<std::atomic<T *>[]>(r->size_);
+            for (int64_t i = t; i < b; i ++) {
+                r->slots_[i & (r->size_ - 1)].store(old->slots_[i & (old->size_ - 1)].load(std::memory_order_relaxed),
+                                                    std::memory_order_relaxed);
+            }
+
+            rings_.push_back(std::move(r));
+            return rings_.back().get();
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * @brief - implements zero copy stream send with MSG_ZEROCOPY
+ *
+ * @copyright 2019-present Devendra Naga (devnaga@tuta.io) All rights reserved
+ */
+#ifndef __AUTO_LIB_ZEROCOPY_SENDER_H__
+#define __AUTO_LIB_ZEROCOPY_SENDER_H__
+
+#include <deque>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <event_manager.h>
+
+// older libc headers lack the zero copy flags
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+namespace auto_os::lib {
+
+// sends below this size are copied, pinning the pages costs more than the copy
+static constexpr size_t zerocopy_default_min_size = 16384;
+
+/**
+ * @brief - implements zerocopy_sender counters
+ */
+struct zerocopy_stats {
+    // sends done with MSG_ZEROCOPY
+    uint64_t zerocopy_sends_ = 0;
+    // sends copied, too small, refused by the kernel or zero copy not supported
+    uint64_t copied_sends_ = 0;
+    // MSG_ZEROCOPY sends completed by the kernel
+    uint64_t completions_ = 0;
+    // completions for which the kernel still had to copy, e.g. over loopback
+    uint64_t kernel_copied_ = 0;
+};
+
+/**
+ * @brief - implements zero copy sender of a connected tcp socket
+ *
+ * @details - a buffer passed to send_msg belongs to the kernel until its done
+ *            callback is called from the event_manager loop, the caller must not
+ *            modify or free it before. completions are read from the error queue
+ *            of the socket. send_msg must be called on the loop thread
+ */
+class zerocopy_sender {
+    public:
+        /**
+         * @brief - enable zero copy on a socket
+         *
+         * @param in evt_mgr - event manager delivering the completions
+         * @param in fd - connected tcp socket, such as tcp_conn::get_socket or tcp_client::get_socket
+         * @param in min_size - sends smaller than this are copied
+         *
+         * @details - if the kernel refuses SO_ZEROCOPY every send is copied
+         *
+         * This constructor will throw exception.
+         */
+        explicit zerocopy_sender(event_manager *evt_mgr, int fd,
+                                 size_t min_size = zerocopy_default_min_size);
+        ~zerocopy_sender();
+
+        zerocopy_sender(const zerocopy_sender &) = delete;
+        zerocopy_sender &operator=(const zerocopy_sender &) = delete;
+
+        /**
+         * @brief - send data
+         *
+         * @param in data - data to send, untouched until done is called
+         * @param in data_len - length of data
+         * @param in done - called once the kernel released the bytes sent. for a copied
+         *                  send it is called before send_msg returns
+         *
+         * @details - a partial send takes the buffer as well, send the rest with another call
+         *
+         * @return number of bytes sent, -1 on failure in which case done is not called
+         */
+        int send_msg(const uint8_t *data, size_t data_len, job_fn done);
+
+        /**
+         * @brief - returns true if the kernel accepted SO_ZEROCOPY
+         */
+        bool enabled() const { return enabled_; }
+
+        /**
+         * @brief - returns number of zero copy sends not completed yet
+         */
+        size_t pending() const { return pending_.size(); }
+
+        zerocopy_stats get_stats() const { return stats_; }
+
+    private:
+        struct pending_send {
+            uint32_t id_;
+            job_fn done_;
+        };
+
+        event_manager *evt_mgr_;
+        int fd_;
+        size_t min_size_;
+        bool enabled_ = false;
+        // the kernel numbers the MSG_ZEROCOPY sends of a socket from 0
+        uint32_t next_id_ = 0;
+        // in send order, tcp completes them in order
+        std::deque<pending_send> pending_;
+        zerocopy_stats stats_;
+
+        int send_copy_(const uint8_t *data, size_t data_len, job_fn &done);
+        void reap_();
+        void complete_(uint32_t lo, uint32_t hi, bool copied);
+};
+
+inline zerocopy_sender::zerocopy_sender(event_manager *evt_mgr, int fd, size_t min_size) :
+                                        evt_mgr_(evt_mgr), fd_(fd), min_size_(min_size)
+{
+    int on = 1;
+
+    enabled_ = (setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0);
+    if (!enabled_) {
+        return;
+    }
+
+    if (evt_mgr_->set_error_event(fd_, [this](int) { reap_(); }) < 0) {
+        throw std::runtime_error("failed to watch the socket error queue");
+    }
+}
+
+inline zerocopy_sender::~zerocopy_sender()
+{
+    if (enabled_) {
+        evt_mgr_->set_error_event(fd_, nullptr);
+    }
+}
+
+inline int zerocopy_sender::send_copy_(const uint8_t *data, size_t data_len, job_fn &done)
+{
+    int ret;
+
+    ret = send(fd_, data, data_len, MSG_NOSIGNAL);
+    if (ret < 0) {
+        return -1;
+    }
+
+    stats_.copied_sends_ ++;
+    if (done) {
+        done();
+    }
+
+    return ret;
+}
+
+inline int zerocopy_sender::send_msg(const uint8_t *data, size_t data_len, job_fn done)
+{
+    int ret;
+
+    if (!enabled_ || (data_len < min_size_)) {
+        return send_copy_(data, data_len, done);
+    }
+
+    ret = send(fd_, data, data_len, static_cast<int>(MSG_ZEROCOPY) | MSG_NOSIGNAL);
+    if (ret < 0) {
+        // out of optmem for the notifications, the copy path still works
+        if (errno == ENOBUFS) {
+            return send_copy_(data, data_len, done);
+        }
+        return -1;
+    }
+
+    stats_.zerocopy_sends_ ++;
+    pending_.push_back(pending_send{next_id_ ++, std::move(done)});
+
+    return ret;
+}
+
+inline void zerocopy_sender::complete_(uint32_t lo, uint32_t hi, bool copied)
+{
+    // ids wrap, compare their distance from lo
+    while (!pending_.empty() && ((uint32_t)(pending_.front().id_ - lo) <= (uint32_t)(hi - lo))) {
+        job_fn done = std::move(pending_.front().done_);
+
+        pending_.pop_front();
+        stats_.completions_ ++;
+        if (copied) {
+            stats_.kernel_copied_ ++;
+        }
+
+        // may send again and queue behind the ones left
+        if (done) {
+            done();
+        }
+    }
+}
+
+inline void zerocopy_sender::reap_()
+{
+    alignas(struct cmsghdr) char ctrl[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+    struct sock_extended_err ee;
+    struct cmsghdr *cm;
+    struct msghdr msg;
+
+    while (1) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        if (recvmsg(fd_, &msg, static_cast<int>(MSG_ERRQUEUE) | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(((cm->cmsg_level == SOL_IP) && (cm->cmsg_type == IP_RECVERR)) ||
+                  ((cm->cmsg_level == SOL_IPV6) && (cm->cmsg_type == IPV6_RECVERR)))) {
+                continue;
+            }
+
+            memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if ((ee.ee_errno != 0) || (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY)) {
+                continue;
+            }
+
+            // ee_info to ee_data is the range of sends completed
+            complete_(ee.ee_info, ee.ee_data, ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+        }
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * @brief - implements event manager tests
+ *
+ * @author - Devendra Naga (devendra.aaru@outlook.com)
+ *
+ * @copyright - 2021-present All rights reserved
+ */
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <event_manager.h>
+
+// a periodic timer that deletes itself from its callback must not fire again
+static int test_timer_self_delete()
+{
+    auto_os::lib::event_manager evt_mgr;
+    auto_os::lib::timer_handle self;
+    int count = 0;
+
+    self = evt_mgr.create_timer_event(0, 1000, [&]() {
+        count ++;
+
+        // the handle is stale once cancelled, a rearm after it must fail
+        if ((evt_mgr.delete_timer_event(self) != 0) ||
+            (evt_mgr.rearm_timer_event(self, 0, 1000) == 0)) {
+            count = -1;
+        }
+    });
+
+    evt_mgr.create_timer_event(true, 0, 20000, [&]() {
+        evt_mgr.terminate();
+    });
+
+    evt_mgr.start();
+
+    return (count == 1) ? 0 : -1;
+}
+
+// a socket callback that deletes its own event keeps its captures until it returns
+static int test_socket_self_delete()
+{
+    struct self_delete_ctx {
+        auto_os::lib::event_manager evt_mgr;
+        std::string seen;
+    } ctx;
+    auto name = std::make_shared<std::string>("self delete");
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        return -1;
+    }
+
+    // small enough to be stored inline in the callback, not on the heap
+    ctx.evt_mgr.create_socket_event(sv[1], [c = &ctx, name](int fd) {
+        char b;
+
+        read(fd, &b, sizeof(b));
+        c->evt_mgr.delete_socket_event(fd);
+
+        c->seen = "socket " + *name;
+        c->evt_mgr.terminate();
+    });
+
+    write(sv[0], "x", 1);
+    ctx.evt_mgr.start();
+
+    close(sv[0]);
+    close(sv[1]);
+
+    return ((ctx.seen == "socket self delete") && (name.use_count() == 1)) ? 0 : -1;
+}
+
+int test_event_manager()
+{
+    auto_os::lib::event_manager *evt_mgr = auto_os::lib::event_manager::instance();
+    auto_os::lib::timer_handle cancelled;
+    auto_os::lib::socket_handle rx;
+    auto_os::lib::event_manager_stats stats;
+    int timer_count = 0;
+    int cancelled_count = 0;
+    int rx_count = 0;
+    int sv[2];
+    int ret;
+
+    ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    if (ret < 0) {
+        return -1;
+    }
+
+    evt_mgr->enable_stats(true);
+
+    evt_mgr->create_timer_event(0, 10000, [&]() {
+        timer_count ++;
+        write(sv[0], "x", 1);
+        if (timer_count == 5) {
+            evt_mgr->terminate();
+        }
+    });
+
+    // cancelled before it expires, the handle is stale afterwards
+    cancelled = evt_mgr->create_timer_event(true, 0, 20000, [&]() {
+        cancelled_count ++;
+    });
+    if ((evt_mgr->delete_timer_event(cancelled) != 0) ||
+        (evt_mgr->delete_timer_event(cancelled) == 0)) {
+        return -1;
+    }
+
+    rx = evt_mgr->create_socket_event(sv[1], [&](int fd) {
+        char c;
+
+        read(fd, &c, sizeof(c));
+        rx_count ++;
+
+        // deleting the running callback must be safe
+        if (rx_count == 3) {
+            evt_mgr->delete_socket_event(fd);
+        }
+    }, auto_os::lib::evt_trigger_mode::level);
+
+    // ready ahead of sources without a deadline, a stale timer takes none
+    if ((evt_mgr->set_deadline(rx, 100000) != 0) ||
+        (evt_mgr->set_deadline(cancelled, 100000) == 0)) {
+        return -1;
+    }
+
+    evt_mgr->start();
+
+    close(sv[0]);
+    close(sv[1]);
+
+    stats = evt_mgr->get_stats();
+    evt_mgr->enable_stats(false);
+
+    printf("timer_count [%d] rx_count [%d] timer lateness mean [%lu ns]\n",
+           timer_count, rx_count, stats.timer_late_ns_.mean());
+    if ((timer_count != 5) || (rx_count != 3) || (cancelled_count != 0)) {
+        return -1;
+    }
+
+    if ((stats.timer_cb_ns_.count_ != 5) || (stats.socket_cb_ns_.count_ != 3)) {
+        return -1;
+    }
+
+    if (test_timer_self_delete() < 0) {
+        return -1;
+    }
+
+    if (test_socket_self_delete() < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
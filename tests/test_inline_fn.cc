@@ -0,0 +1,87 @@
+/**
+ * @brief - implements inline_fn tests and benchmark
+ *
+ * @author - Devendra Naga (devendra.aaru@outlook.com)
+ *
+ * @copyright - 2021-present All rights reserved
+ */
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <inline_fn.h>
+
+int test_inline_fn()
+{
+    auto_os::lib::inline_fn<int(int)> small;
+    auto_os::lib::inline_fn<int(int)> moved;
+    auto owned = std::make_unique<int>(5);
+#if !defined(CONFIG_INLINE_FN_STRICT)
+    auto_os::lib::inline_fn<int(void)> large;
+    uint64_t pad[16] = {1};
+#endif
+
+    if (small) {
+        return -1;
+    }
+
+    // move-only captures are allowed
+    small = [owned = std::move(owned)](int v) { return v + *owned; };
+    moved = std::move(small);
+    if (small || !moved || (moved(1) != 6)) {
+        return -1;
+    }
+
+#if !defined(CONFIG_INLINE_FN_STRICT)
+    // larger than the inline storage, allocated
+    large = [pad]() { return (int)pad[0]; };
+    if (large() != 1) {
+        return -1;
+    }
+#endif
+
+    moved = nullptr;
+    if (moved || (moved.target_type() != typeid(void))) {
+        return -1;
+    }
+
+    return 0;
+}
+
+template <typename F>
+static double bench_dispatch(int n_events)
+{
+    uint64_t a = 1, b = 2, c = 3, d = 4;
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    // an event callback is created, queued (moved) and called once
+    for (int i = 0; i < n_events; i ++) {
+        F fn([&sum, a, b, c, d, i]() { sum += a + b + c + d + i; });
+        F queued(std::move(fn));
+
+        queued();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    if (sum == 0) {
+        return 0;
+    }
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / n_events;
+}
+
+int test_inline_fn_bench()
+{
+    const int n_events = 10000000;
+    double std_ns;
+    double inline_ns;
+
+    std_ns = bench_dispatch<std::function<void(void)>>(n_events);
+    inline_ns = bench_dispatch<auto_os::lib::inline_fn<void(void)>>(n_events);
+
+    printf("per event: std::function [%.2f ns] inline_fn [%.2f ns]\n", std_ns, inline_ns);
+
+    return 0;
+}
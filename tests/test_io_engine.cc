@@ -0,0 +1,169 @@
+/**
+ * @brief - implements I/O engine tests
+ *
+ * @author - Devendra Naga (devendra.aaru@outlook.com)
+ *
+ * @copyright - 2021-present All rights reserved
+ */
+#include <iostream>
+#include <cerrno>
+#include <memory>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <io_engine_factory.h>
+
+// reap until done is set, gives up after a second
+static void reap_until(auto_os::lib::io_engine *io, const bool &done)
+{
+    int i;
+
+    for (i = 0; (i < 1000) && !done; i ++) {
+        io->reap();
+        if (!done) {
+            usleep(1000);
+        }
+    }
+}
+
+// returns the socket of a new pair that took the number fd, the other end in peer
+static int reuse_fd(int fd, int &peer)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        return -1;
+    }
+
+    if (sv[0] == fd) {
+        peer = sv[1];
+        return sv[0];
+    }
+    if (sv[1] == fd) {
+        peer = sv[0];
+        return sv[1];
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+    return -1;
+}
+
+static int test_io_engine_fd_reuse(auto_os::lib::io_engine *io, bool cancel)
+{
+    uint8_t old_buf[16];
+    uint8_t new_buf[16];
+    uint8_t msg[4] = {1, 2, 3, 4};
+    bool old_done = false;
+    bool new_done = false;
+    int old_res = 0;
+    int new_res = 0;
+    int sv[2];
+    int peer;
+    int fd;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        return -1;
+    }
+
+    io->submit_read(sv[0], old_buf, sizeof(old_buf), [&](int res) {
+        old_res = res;
+        old_done = true;
+    });
+    io->flush();
+
+    if (cancel) {
+        io->cancel_fd(sv[0]);
+    }
+    fd = sv[0];
+    close(sv[0]);
+    close(sv[1]);
+
+    if (cancel) {
+        reap_until(io, old_done);
+        if (!old_done || (old_res != -ECANCELED)) {
+            return -1;
+        }
+    }
+
+    fd = reuse_fd(fd, peer);
+    if (fd < 0) {
+        return -1;
+    }
+
+    io->submit_read(fd, new_buf, sizeof(new_buf), [&](int res) {
+        new_res = res;
+        new_done = true;
+    });
+    io->flush();
+    send(peer, msg, sizeof(msg), 0);
+
+    // without the cancel the stale read is served first, the new one must not hang
+    if (!cancel) {
+        reap_until(io, old_done);
+        if (!old_done) {
+            return -1;
+        }
+        send(peer, msg, sizeof(msg), 0);
+    }
+
+    reap_until(io, new_done);
+
+    io->cancel_fd(fd);
+    close(fd);
+    close(peer);
+
+    if (!new_done || (new_res != sizeof(msg))) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_io_engine_bad_fd(auto_os::lib::io_engine *io)
+{
+    uint8_t buf[16];
+    bool done = false;
+    int res = 0;
+
+    io->submit_read(-1, buf, sizeof(buf), [&](int r) {
+        res = r;
+        done = true;
+    });
+    io->flush();
+    reap_until(io, done);
+
+    return (done && (res == -EBADF)) ? 0 : -1;
+}
+
+int test_io_engine()
+{
+    auto_os::lib::io_engine_factory *fac = auto_os::lib::io_engine_factory::instance();
+    std::shared_ptr<auto_os::lib::io_engine> io;
+
+    io = fac->create(auto_os::lib::io_engine_type::epoll, 0);
+    if (!io) {
+        return -1;
+    }
+
+    if ((test_io_engine_fd_reuse(io.get(), true) < 0) ||
+        (test_io_engine_fd_reuse(io.get(), false) < 0) ||
+        (test_io_engine_bad_fd(io.get()) < 0)) {
+        return -1;
+    }
+
+    // falls back to epoll on kernels without the io_uring features in use
+    io = fac->create(auto_os::lib::io_engine_type::io_uring, 64);
+    if (!io) {
+        return -1;
+    }
+
+    if ((test_io_engine_fd_reuse(io.get(), true) < 0) ||
+        (test_io_engine_bad_fd(io.get()) < 0)) {
+        return -1;
+    }
+
+    fprintf(stderr, "io_uring engine [%s]\n",
+            (io->get_type() == auto_os::lib::io_engine_type::io_uring) ? "yes" : "no, epoll");
+
+    return 0;
+}
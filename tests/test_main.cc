@@ -31,6 +31,12 @@ int test_mcast();
 int test_compress();
 #endif
 int test_cpuusage();
+int test_event_manager();
+int test_thread_pool();
+int test_inline_fn();
+int test_inline_fn_bench();
+int test_udp_gso_bench();
+int test_io_engine();
 
 /**
  * @brief defines the test cases to be automated
@@ -63,6 +69,12 @@ static struct test_case_def {
     {"test_mcast",              test_mcast,                 false},
 #endif
     {"test_cpuusage",           test_cpuusage,              true},
+    {"test_event_manager",      test_event_manager,         true},
+    {"test_thread_pool",        test_thread_pool,           true},
+    {"test_inline_fn",          test_inline_fn,             true},
+    {"test_inline_fn_bench",    test_inline_fn_bench,       false},
+    {"test_udp_gso_bench",      test_udp_gso_bench,         false},
+    {"test_io_engine",          test_io_engine,             true},
 };
 
 int main(int argc, char **argv)
@@ -0,0 +1,140 @@
+/**
+ * @brief - implements thread pool tests
+ *
+ * @author - Devendra Naga (devendra.aaru@outlook.com)
+ *
+ * @copyright - 2021-present All rights reserved
+ */
+#include <iostream>
+#include <atomic>
+#include <stdexcept>
+#include <thread_pool.h>
+#include <task_graph.h>
+
+// a throwing chunk or task is rethrown to the caller once the others are done
+static int test_thread_pool_exceptions(auto_os::lib::thread_pool &tasks)
+{
+    std::atomic<int> chunks{0};
+    std::vector<int> ran;
+    std::mutex ran_lock;
+    bool thrown = false;
+    int i;
+
+    try {
+        tasks.parallel_for(0, 100, 10, [&](size_t b, size_t) {
+            if (b == 50) {
+                throw std::runtime_error("chunk failed");
+            }
+            chunks ++;
+        });
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown || (chunks != 9)) {
+        return -1;
+    }
+
+    // 0 -> 1 -> 2 are skipped from the throwing 0, 3 -> 4 is independent of it
+    auto_os::lib::task_graph graph(&tasks);
+
+    for (i = 0; i < 5; i ++) {
+        graph.add_task([&, i]() {
+            if (i == 0) {
+                throw std::runtime_error("task failed");
+            }
+
+            std::lock_guard<std::mutex> lock(ran_lock);
+
+            ran.push_back(i);
+        });
+    }
+    graph.add_dependency(0, 1);
+    graph.add_dependency(1, 2);
+    graph.add_dependency(3, 4);
+
+    thrown = false;
+    try {
+        graph.run();
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    if (!thrown || (ran != std::vector<int>{3, 4})) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int test_thread_pool()
+{
+    auto_os::lib::thread_pool pool(4);
+    auto_os::lib::thread_pool tasks(4);
+    auto_os::lib::thread_pool_stats stats;
+    std::atomic<int> count{0};
+    uint64_t executed = 0;
+    std::atomic<uint64_t> sum{0};
+    std::vector<int> order;
+    std::mutex order_lock;
+    int i;
+
+    auto_os::lib::task_future<int> f = tasks.submit([]() { return 42; });
+    if (f.get() != 42) {
+        return -1;
+    }
+
+    tasks.parallel_for(0, 10000, 0, [&](size_t b, size_t e) {
+        for (size_t k = b; k < e; k ++) {
+            sum += k;
+        }
+    });
+    if (sum != 49995000) {
+        return -1;
+    }
+
+    // 0 -> {1, 2} -> 3
+    auto_os::lib::task_graph graph(&tasks);
+
+    for (i = 0; i < 4; i ++) {
+        graph.add_task([&, i]() {
+            std::lock_guard<std::mutex> lock(order_lock);
+
+            order.push_back(i);
+        });
+    }
+    graph.add_dependency(0, 1);
+    graph.add_dependency(0, 2);
+    graph.add_dependency(1, 3);
+    graph.add_dependency(2, 3);
+    if ((graph.run() != 0) || (order.size() != 4) ||
+        (order.front() != 0) || (order.back() != 3)) {
+        return -1;
+    }
+
+    if (test_thread_pool_exceptions(tasks) < 0) {
+        return -1;
+    }
+
+    // every job queues two more from inside the pool, those go to the worker deques
+    for (i = 0; i < 1000; i ++) {
+        pool.queue_work([&]() {
+            count ++;
+            for (int j = 0; j < 2; j ++) {
+                pool.queue_work([&]() { count ++; });
+            }
+        });
+    }
+
+    pool.stopall();
+
+    stats = pool.get_stats();
+    for (auto &it : stats.workers_) {
+        executed += it.executed;
+    }
+
+    printf("count [%d] executed [%lu]\n", count.load(), executed);
+    if ((count != 3000) || (executed != 3000) || (stats.inject_depth != 0)) {
+        return -1;
+    }
+
+    return 0;
+}
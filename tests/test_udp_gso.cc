@@ -0,0 +1,82 @@
+/**
+ * @brief - implements udp segmentation offload benchmark over loopback
+ *
+ * @author - Devendra Naga (devendra.aaru@outlook.com)
+ *
+ * @copyright - 2021-present All rights reserved
+ */
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <socket_api.h>
+
+static const int bench_port = 19600;
+static const uint16_t bench_segment = 1200;
+static const size_t bench_datagrams = 500000;
+
+static double bench_send(auto_os::lib::udp_client &cli, const auto_os::lib::net_endpoint &ep, bool gso)
+{
+    std::vector<uint8_t> buf(bench_segment * auto_os::lib::udp_gso_max_segments);
+    size_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (sent < bench_datagrams) {
+        if (gso) {
+            if (cli.send_gso(ep, buf.data(), buf.size(), bench_segment) < 0) {
+                return 0;
+            }
+            sent += auto_os::lib::udp_gso_max_segments;
+        } else {
+            if (cli.send_msg(ep, buf.data(), bench_segment) < 0) {
+                return 0;
+            }
+            sent ++;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    return sent / std::chrono::duration<double>(end - start).count();
+}
+
+int test_udp_gso_bench()
+{
+    auto_os::lib::udp_server srv("127.0.0.1", bench_port);
+    auto_os::lib::udp_client cli;
+    auto_os::lib::net_endpoint ep("127.0.0.1", bench_port);
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> rx{0};
+    double plain_pps;
+    double gso_pps;
+
+    // a train is counted as the datagrams it carries
+    srv.enable_gro();
+    std::thread receiver([&]() {
+        std::vector<uint8_t> buf(65536);
+        auto_os::lib::udp_msg msg;
+        uint16_t seg;
+        int ret;
+
+        msg.data_ = buf.data();
+        msg.data_len_ = buf.size();
+        while (!stop) {
+            ret = srv.recv_gro(msg, seg);
+            if (ret > 0) {
+                rx += (ret + seg - 1) / seg;
+            }
+        }
+    });
+
+    plain_pps = bench_send(cli, ep, false);
+    gso_pps = bench_send(cli, ep, true);
+
+    stop = true;
+    receiver.join();
+
+    printf("send pps: sendto [%.0f] UDP_SEGMENT [%.0f] gain [%.2fx] received [%lu]\n",
+           plain_pps, gso_pps, plain_pps ? gso_pps / plain_pps : 0, rx.load());
+
+    return ((plain_pps > 0) && (gso_pps > 0)) ? 0 : -1;
+}